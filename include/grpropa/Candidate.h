@@ -11,12 +11,18 @@
 
 namespace grpropa {
 
+/** Interned property name or value, see Candidate::internProperty */
+typedef int PropertyKey;
+
 /**
  @class Candidate
  @brief All information about the cosmic ray.
 
  The Candidate is a passive object, that holds the information about the state
  of the particle and the simulation itself.
+ Candidates are allocated from thread local pools, as electromagnetic cascades
+ create and release them in large numbers. The memory of released candidates
+ is reused by later ones but not returned to the system.
  */
 class Candidate: public Referenced {
 public:
@@ -28,9 +34,27 @@ public:
     std::vector<ref_ptr<Candidate> > secondaries; /**< Secondary particles from interactions */
 
     typedef Loki::AssocVector<std::string, std::string> PropertyMap;
-    PropertyMap properties; /**< Map of property names and their values. */
+
+    static const int nPropertySlots = 4; /**< Number of properties that can be set by key */
 
 private:
+    /**
+     Properties set by name, or by key when all slots are taken. Private, as
+     it does not list the properties in the slots: use getProperties.
+     */
+    PropertyMap properties;
+
+    struct Record {
+        const Referenced *owner;
+        ref_ptr<Referenced> data;
+    };
+    std::vector<Record> records; /**< See getRecord */
+    struct PropertySlot {
+        PropertyKey name; /**< -1 for an empty slot */
+        PropertyKey value;
+    };
+    PropertySlot propertySlots[nPropertySlots]; /**< Properties set by key */
+
     bool active; /**< Active status */
     double redshift; /**< Current simulation time-point in terms of redshift z */
     double trajectoryLength; /**< Comoving distance [m] the candidate has travelled so far */
@@ -79,6 +103,33 @@ public:
     bool removeProperty(const std::string &name);
     bool hasProperty(const std::string &name) const;
 
+    /**
+     Returns the key of a property name or value, registering it if necessary.
+     Keys are meant to be obtained once, e.g. when a module is configured.
+     Properties accessed by key are held in a few fixed slots, so that setting
+     and checking them involves neither allocations nor string comparisons.
+     Both ways of access refer to the same properties.
+     Keys are never released, so a candidate keeps its values after the
+     module that set them is changed or destroyed.
+     */
+    static PropertyKey internProperty(const std::string &name);
+    static const std::string &getPropertyName(PropertyKey key);
+
+    void setProperty(PropertyKey name, PropertyKey value);
+    bool removeProperty(PropertyKey name);
+    bool hasProperty(PropertyKey name) const;
+
+    /** All properties, whether set by name or by key */
+    PropertyMap getProperties() const;
+
+    /**
+     Data that a module (the owner) keeps about this candidate, NULL if none,
+     e.g. the state of TrajectoryOutput. Secondaries start with the records
+     of their parent.
+     */
+    Referenced *getRecord(const Referenced *owner) const;
+    void setRecord(const Referenced *owner, Referenced *data);
+
     /**
      Add a new candidate to the list of secondaries.
      @param id      particle ID of the secondary
@@ -96,6 +147,24 @@ public:
     void clearSecondaries();
 
     std::string getDescription() const;
+
+#ifndef SWIG
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
+#endif
+
+private:
+    /**
+     Creates a secondary of the given parent, see addSecondary.
+     */
+    Candidate(const Candidate &parent, int id, double energy);
+
+    void clearPropertySlots();
+    // slot of a property name, -1 if not set by key
+    int findPropertySlot(PropertyKey name) const;
+    int nPropertySlotsUsed() const;
+    // key of a property name, -1 if it has never been interned
+    static PropertyKey findPropertyKey(const std::string &name);
 };
 
 } // namespace grpropa
@@ -2,6 +2,7 @@
 #define GRPROPA_GRIDTOOLS_H
 
 #include "grpropa/Grid.h"
+#include "grpropa/QuantizedGrid.h"
 #include <string>
 
 namespace grpropa {
@@ -34,6 +35,18 @@ void scaleGrid(ref_ptr<VectorGrid> grid, double a);
 void initTurbulence(ref_ptr<VectorGrid> grid, double Brms, double lMin, double lMax, double alpha = -11./3., int seed = 0, bool helicity = false, double H = 0.);
 #endif // GRPROPA_HAVE_FFTW3F
 
+/**
+ Interpolation error of a quantized grid against the grid it was encoded from,
+ sampled at random positions within the grid volume:
+ RMS of |B_quantized - B| divided by the RMS of |B| over the same positions.
+ */
+double quantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid16> quantized, size_t nSamples = 100000, int seed = 0);
+double quantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid8> quantized, size_t nSamples = 100000, int seed = 0);
+
+/** Same as quantizationError, but the maximum of |B_quantized - B| divided by the RMS of |B| */
+double maxQuantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid16> quantized, size_t nSamples = 100000, int seed = 0);
+double maxQuantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid8> quantized, size_t nSamples = 100000, int seed = 0);
+
 /** Analytically calculate the correlation length of a turbulent field */
 double turbulentCorrelationLength(double lMin, double lMax, double alpha = -11./3.);
 
@@ -53,12 +66,45 @@ void loadGrid(ref_ptr<VectorGrid> grid, std::string filename, double conversion
 // Load a ScalarGrid from a binary file with single precision.
 void loadGrid(ref_ptr<ScalarGrid> grid, std::string filename, double conversion = 1);
 
+/**
+ Map a binary file with single precision read-only into a grid with the
+ linear layout, instead of loading it. Pages are read from the file on first
+ access and are shared between processes through the page cache, so large
+ fields load instantly and several processes on one node hold them only once.
+ The values are used as stored (no conversion factor), so the file should be
+ in the units of the simulation, e.g. written with dumpGrid(grid, file, 1).
+ Changes to the values stay private to the process and are never written back.
+ */
+void mapGrid(ref_ptr<VectorGrid> grid, std::string filename);
+void mapGrid(ref_ptr<ScalarGrid> grid, std::string filename);
+
+/**
+ Create a grid that maps a binary file, see mapGrid.
+ Unlike constructing the grid first, this never allocates the internal storage.
+ */
+ref_ptr<VectorGrid> mapVectorGrid(std::string filename, Vector3d origin,
+        size_t Nx, size_t Ny, size_t Nz, double spacing);
+ref_ptr<ScalarGrid> mapScalarGrid(std::string filename, Vector3d origin,
+        size_t Nx, size_t Ny, size_t Nz, double spacing);
+
 // Dump a VectorGrid to a binary file.
 void dumpGrid(ref_ptr<VectorGrid> grid, std::string filename, double conversion = 1);
 
 // Dump a ScalarGrid to a binary file with single precision.
 void dumpGrid(ref_ptr<ScalarGrid> grid, std::string filename, double conversion = 1);
 
+/**
+ Dump / load a quantized grid to / from a binary file: Nx, Ny, Nz and the
+ bytes per component (uint32 each), the scales of all bricks (single
+ precision), then the integer components, both in the storage order of the
+ grid. Origin and spacing are not stored; the grid to load into is created
+ with the same geometry, loading throws if its size does not match.
+ */
+void dumpGrid(ref_ptr<QuantizedVectorGrid16> grid, std::string filename);
+void dumpGrid(ref_ptr<QuantizedVectorGrid8> grid, std::string filename);
+void loadGrid(ref_ptr<QuantizedVectorGrid16> grid, std::string filename);
+void loadGrid(ref_ptr<QuantizedVectorGrid8> grid, std::string filename);
+
 // Load a VectorGrid grid from a plain text file.
 void loadGridFromTxt(ref_ptr<VectorGrid> grid, std::string filename, double conversion = 1);
 
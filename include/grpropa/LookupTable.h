@@ -0,0 +1,65 @@
+#ifndef GRPROPA_LOOKUPTABLE_H
+#define GRPROPA_LOOKUPTABLE_H
+
+#include <vector>
+#include <cstddef>
+
+namespace grpropa {
+
+/**
+ @class LookupAxis
+ @brief Sorted grid of nodes for table lookups
+
+ When the nodes are set, the axis checks whether they are uniformly spaced in
+ log(x), optionally after a leading node at zero (e.g. z = 0 in a redshift
+ table). For such grids the bin of a value is found with a single log and a
+ multiplication; the result is corrected against the actual node values, so
+ rounding in the tabulated nodes does not change the bin. Irregular grids
+ fall back to a binary search.
+ */
+class LookupAxis {
+    std::vector<double> nodes;
+    bool logUniform;
+    size_t first; // first node of the log-uniform part, 0 or 1
+    double logFirst; // log of nodes[first]
+    double invLogStep; // inverse log spacing
+public:
+    LookupAxis();
+    LookupAxis(const std::vector<double> &nodes);
+    void setNodes(const std::vector<double> &nodes);
+    const std::vector<double> &getNodes() const;
+    bool isLogUniform() const;
+
+    size_t size() const {
+        return nodes.size();
+    }
+    bool empty() const {
+        return nodes.empty();
+    }
+    double front() const {
+        return nodes.front();
+    }
+    double back() const {
+        return nodes.back();
+    }
+    double operator[](size_t i) const {
+        return nodes[i];
+    }
+
+    /**
+     Number of nodes that are <= x, i.e. the index of the first node > x.
+     Same as std::upper_bound(nodes.begin(), nodes.end(), x) - nodes.begin().
+     */
+    size_t upperBound(double x) const;
+};
+
+// Linear interpolation, see interpolate in Common.h
+double interpolate(double x, const LookupAxis &X, const std::vector<double> &Y);
+
+// Bilinear interpolation with Z[i * Y.size() + j] at (X[i], Y[j]), see interpolate2d in Common.h
+double interpolate2d(double x, double y, const LookupAxis &X,
+        const LookupAxis &Y, const std::vector<double> &Z);
+
+} // namespace grpropa
+
+#endif // GRPROPA_LOOKUPTABLE_H
@@ -24,6 +24,24 @@ public:
     virtual std::string getDescription() const;
     void setDescription(const std::string &description);
     virtual void process(Candidate *candidate) const = 0;
+
+#ifndef SWIG
+    /**
+     Process n candidates that advance together, see ModuleList::setBatchSize.
+     The default processes them one by one; modules that can share work
+     between candidates (e.g. one field evaluation for all of them) override it.
+     Hidden from SWIG, so that the director of a Python module does not
+     override it and batches reach Python through process(candidate).
+     */
+    virtual void process(Candidate **candidates, size_t n) const;
+#endif
+
+    /**
+     Called by ModuleList::endRun, outside of any parallel region, at the end
+     of the runs over a candidate vector or a source and after a series of
+     single candidates, e.g. to write buffered output.
+     */
+    virtual void endRun();
     inline void process(ref_ptr<Candidate> candidate) const {
         process(candidate.get());
     }
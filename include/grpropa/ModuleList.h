@@ -10,25 +10,90 @@
 
 namespace grpropa {
 
+class ProgressBar;
+
 /**
  @class ModuleList
  @brief List of modules
+
+ When parallel cascades are enabled, every secondary is handed to the OpenMP
+ runtime as a separate task as soon as it has been created. Idle threads can
+ then take over parts of a deep electromagnetic cascade instead of waiting for
+ the thread that processes its primary.
+
+ When secondaries are released, the secondaries of every step are propagated
+ right away and dropped from their parent afterwards. The memory then scales
+ with the width of the active cascade instead of its total size, but the
+ secondaries can no longer be inspected after the run.
+
+ The primaries are distributed on the threads according to the selected
+ scheduling. With the cost predicted scheduling the primaries are sorted by
+ their energy, as an estimate of the cascade size, and the most expensive ones
+ are dealt out first. The time each thread spent propagating and waiting is
+ recorded for every run over a source or a candidate vector.
+
+ With a batch size above one, each thread takes that many primaries at once
+ and propagates them in lockstep: every module processes all active candidates
+ of the batch before the next module runs, so modules like PropagationCK can
+ evaluate the field for all of them together. The secondaries of a batch are
+ propagated the same way, generation by generation. Batches are not combined
+ with parallel cascades, which take precedence.
  */
 class ModuleList: public Referenced {
 public:
     typedef std::list<ref_ptr<Module> > module_list_t;
     typedef std::vector<ref_ptr<Candidate> > candidate_vector_t;
 
+    enum Scheduling {
+        StaticScheduling, DynamicScheduling, GuidedScheduling, CostPredictedScheduling
+    };
+
     ModuleList();
     virtual ~ModuleList();
     void setShowProgress(bool show);
 
+    /** Propagate secondaries as independent OpenMP tasks (default: off) */
+    void setParallelCascades(bool parallel);
+    bool getParallelCascades() const;
+
+    /** Release secondaries as soon as they have been propagated (default: off) */
+    void setReleaseSecondaries(bool release);
+    bool getReleaseSecondaries() const;
+
+    /**
+     Set the distribution of the primaries on the threads.
+     @param scheduling  static (default), dynamic, guided or cost predicted
+     @param chunkSize   number of primaries per chunk, 0 selects 1000 for the
+                        static and 1 for all other schedulings
+     */
+    void setScheduling(Scheduling scheduling, size_t chunkSize = 0);
+    Scheduling getScheduling() const;
+    size_t getChunkSize() const;
+
+    /** Number of candidates propagated in lockstep, 0 or 1 disables batching (default) */
+    void setBatchSize(size_t batchSize);
+    size_t getBatchSize() const;
+
+    /** Time [s] each thread spent propagating candidates during the last run */
+    std::vector<double> getThreadBusyTimes() const;
+    /** Time [s] each thread spent idle during the last run */
+    std::vector<double> getThreadIdleTimes() const;
+
     void add(Module* module);
     virtual void process(Candidate *candidate);
+    virtual void process(Candidate **candidates, size_t n);
+    /** Propagate a single candidate, without ending the run (see endRun) */
     void run(Candidate *candidate, bool recursive = true);
     void run(candidate_vector_t &candidates, bool recursive = true);
     void run(Source *source, size_t count, bool recursive = true);
 
+    /**
+     Let the modules finish the run, see Module::endRun. Done at the end of the
+     runs over a candidate vector or a source; after a series of single
+     candidates it has to be called by the user, outside of parallel regions.
+     */
+    void endRun();
+
     module_list_t &getModules();
     const module_list_t &getModules() const;
 
@@ -36,8 +101,50 @@ public:
     void showModules() const;
 
 private:
+    struct ThreadLoad {
+        double busy;
+        char padding[64 - sizeof(double)];
+    };
+
+    // propagate a candidate without its secondaries, optionally for one step only
+    void propagate(Candidate *candidate, bool singleStep = false);
+    // propagate a primary from the parallel loops
+    void runPrimary(Candidate *candidate, bool recursive);
+    // propagate a candidate and, if recursive, its secondaries
+    void runCandidate(Candidate *candidate, bool recursive);
+    // propagate the candidates in the order of decreasing estimated cost,
+    // if release, each primary is dropped from the vector when it is done
+    void runSorted(candidate_vector_t &candidates, bool recursive, ProgressBar &progressbar, bool release = false);
+    // propagate the candidates in the given order, batchSize at a time
+    void runBatches(candidate_vector_t &candidates, const std::vector<size_t> &order, bool recursive, ProgressBar &progressbar, bool release = false);
+    // propagate a batch of candidates in lockstep, then their secondaries
+    void runBatch(Candidate **candidates, size_t n, bool recursive);
+    // propagate a batch of candidates without their secondaries
+    void propagate(Candidate **candidates, size_t n);
+    bool useBatches() const;
+    // chunk size of the parallel loops over primaries or batches
+    size_t loopChunkSize() const;
+    void startLoadRecording();
+    void stopLoadRecording();
+
+    // propagate and release the current secondaries of a candidate
+    void runSecondaries(Candidate *candidate);
+    // propagate a candidate, its secondaries are spawned as tasks
+    void runCascade(Candidate *candidate);
+    // hand the secondaries from index nDone onwards to the task queue
+    void spawnSecondaries(Candidate *candidate, size_t &nDone);
+
     module_list_t modules;
     bool showProgress;
+    bool parallelCascades;
+    bool releaseSecondaries;
+    Scheduling scheduling;
+    size_t chunkSize;
+    size_t batchSize;
+    std::vector<ThreadLoad> threadLoad;
+    double runTime;
+    double runStart;
+    bool recordLoad;
 };
 
 } // namespace grpropa
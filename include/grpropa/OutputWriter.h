@@ -0,0 +1,112 @@
+#ifndef GRPROPA_OUTPUTWRITER_H
+#define GRPROPA_OUTPUTWRITER_H
+
+#include "grpropa/Referenced.h"
+#include "grpropa/ThreadSlots.h"
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace grpropa {
+
+/**
+ @class OutputWriter
+ @brief Output file that is written by a background thread from per-thread buffers
+
+ Every thread appends its records to its own staging buffer, under a
+ lock of that buffer that is only contended when the writer thread takes it.
+ A buffer is handed to the writer thread as one block when it exceeds the
+ block size, when its oldest record is older than the flush interval (checked
+ on every write of that thread, and by the writer thread once per interval
+ for threads that stopped writing, so no record waits much longer than two
+ intervals), on flush() from the same thread, or on sync() and close().
+ Threads beyond MAX_THREAD share one buffer. The writer thread writes
+ the blocks in the order they are handed over. The records of one write call
+ stay together, but the records of different threads are interleaved blockwise.
+
+ Files whose name ends in .gz are compressed (if built with zlib): the
+ thread that hands over a buffer compresses it into a gzip member of its
+ own, so the threads compress in parallel and every block can be
+ decompressed independently. The concatenated members form a regular gzip
+ file (e.g. for zcat or numpy.loadtxt).
+
+ sync() and close() may only be called while no other thread writes, e.g.
+ after a run (see Module::endRun). Errors while writing (a block that could
+ not be compressed or written, a write after close) do not throw, as writes
+ come from parallel regions: the first one is thrown by the next sync() or
+ close(). The destructor closes the file.
+ */
+class OutputWriter: public Referenced {
+public:
+    /**
+     @param filename        file to create
+     @param blockSize       size of the staging buffer of a thread before it is handed over [bytes]
+     @param flushInterval   maximum age of a record in a staging buffer [s], 0 to hand over every record
+     @param compression     gzip level from 1 (fastest) to 9, 0 for none, -1 for 1 if the filename ends in .gz and none otherwise
+     */
+    OutputWriter(const std::string &filename, size_t blockSize = 1 << 20,
+            double flushInterval = 1., int compression = -1);
+    ~OutputWriter();
+
+    /** Append a record to the buffer of the calling thread */
+    void write(const char *data, size_t length);
+    void write(const std::string &data);
+
+    /** Hand the buffer of the calling thread to the writer thread */
+    void flush();
+
+    /** Hand all buffers to the writer thread and wait until the file is written */
+    void sync();
+
+    /** Write everything, stop the writer thread and close the file */
+    void close();
+
+    const std::string &getFilename() const;
+    /** gzip level, 0 if the file is not compressed */
+    int getCompression() const;
+    /** Bytes handed to the writer thread so far, after compression */
+    size_t getBytesWritten() const;
+
+private:
+    struct Buffer {
+        pthread_mutex_t lock; /**< Guards data and since */
+        std::string data;
+        double since; /**< Time of the oldest record in data */
+    };
+    ThreadSlots<Buffer> buffers;
+
+    std::string filename;
+    int fd;
+    size_t blockSize;
+    double flushInterval;
+    int compression;
+    size_t bytesWritten;
+    bool closed;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake; /**< Signals new blocks or the end to the writer thread */
+    pthread_cond_t done; /**< Signals that the queue has been written */
+    std::deque<std::string> queue;
+    std::vector<std::string> spare; /**< Written blocks to be reused */
+    size_t pending; /**< Blocks queued or being written */
+    bool stopping;
+    std::string error; /**< First error, thrown by sync() or close() */
+
+    OutputWriter(const OutputWriter &);
+    OutputWriter &operator=(const OutputWriter &);
+
+    // hand a buffer to the writer thread if its oldest record is at least maxAge old
+    void handOver(Buffer &buffer, double maxAge = 0);
+    bool compress(const std::string &data, std::string &block) const;
+    void setError(const std::string &message);
+    void throwError();
+    static void *run(void *writer);
+    void writeBlocks();
+};
+
+} // namespace grpropa
+
+#endif // GRPROPA_OUTPUTWRITER_H
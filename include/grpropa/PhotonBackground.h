@@ -1,6 +1,13 @@
 #ifndef GRPROPA_PHOTONBACKGROUND_H
 #define GRPROPA_PHOTONBACKGROUND_H
 
+#include "grpropa/LookupTable.h"
+#include "grpropa/Referenced.h"
+#include "grpropa/TableFile.h"
+
+#include <string>
+#include <vector>
+
 namespace grpropa {
 
 // Photon fields
@@ -14,6 +21,112 @@ enum PhotonField {
 // Returns list of available photon background models
 void listOfPhotonBackgroundModels();
 
+// Returns the redshifts of the columns in the tables of a photon field,
+// empty if the tables do not depend on redshift
+std::vector<double> photonFieldRedshifts(PhotonField photonField);
+
+/**
+ @class PhotonEnergySampler
+ @brief Draws background photon energies from a tabulated inverse CDF
+
+ The table gives the photon energy at a set of cumulative probabilities,
+ either once (scaled with 1+z) or for each tabulated redshift (interpolated
+ linearly in z). A guide table over the probability axis makes each draw
+ O(1) on average, with the same result as a binary search.
+ The probability range can be restricted to photons above a minimum energy,
+ e.g. the kinematic threshold of an interaction, so that no draws are wasted
+ on photons that would be rejected anyway.
+ */
+class PhotonEnergySampler {
+public:
+    /** Part of the inverse CDF at a given redshift */
+    struct Range {
+        size_t slice; // lower redshift slice
+        double fraction; // interpolation weight of the upper slice
+        double scale; // energy scaling (1+z) for a redshift independent table
+        double uLow, uHigh; // range of the cumulative probability
+        bool empty; // no photons in the requested range
+    };
+
+    PhotonEnergySampler();
+
+    /**
+     Sets the table: energies[i * probabilities.size() + j] is the photon
+     energy at cumulative probability probabilities[j] and redshift
+     redshifts[i]. Without redshifts only the first row is used.
+     */
+    void setTable(const std::vector<double> &probabilities,
+            const std::vector<double> &energies,
+            const std::vector<double> &redshifts = std::vector<double>());
+
+    /** Range of photons with energy >= emin at redshift z */
+    Range getRange(double z, double emin = 0) const;
+
+    /** Photon energy for a uniform random number u in [0, 1] */
+    double sample(const Range &range, double u) const;
+
+private:
+    std::vector<double> probabilities;
+    std::vector<double> energies;
+    LookupAxis redshiftAxis; // empty for a redshift independent table
+    std::vector<size_t> guide; // guide[k]: number of probabilities <= k / guide.size()
+
+    double energyAt(const Range &range, size_t j) const;
+};
+
+/**
+ @class InteractionRateTable
+ @brief Tabulated interaction rate in a photon field
+
+ Loaded once per process and shared by all modules, see getInteractionRateTable.
+ */
+class InteractionRateTable: public Referenced {
+public:
+    std::vector<double> energies; /**< particle energy [J] */
+    std::vector<double> redshifts; /**< redshifts of the rate columns, empty if redshift independent */
+    std::vector<double> rates; /**< rates[i * energies.size() + j] at redshifts[i] and energies[j] [1/m] */
+    LookupAxis energyAxis; /**< lookup of energies */
+    LookupAxis redshiftAxis; /**< lookup of redshifts */
+};
+
+/**
+ @class PhotonEnergyTable
+ @brief Tabulated energy distribution of background photons
+
+ Loaded once per process and shared by all modules, see getPhotonEnergyTable.
+ */
+class PhotonEnergyTable: public Referenced {
+public:
+    std::vector<double> redshifts; /**< redshifts of the table columns, empty if redshift independent */
+    PhotonEnergySampler sampler; /**< redshift dependent if redshifts are tabulated */
+    PhotonEnergySampler localSampler; /**< z = 0 distribution, scaled with (1+z) */
+};
+
+/**
+ Return the interaction rates in a file of the given photon field.
+ The file is read on first use; later calls, also from other modules, share the same table.
+ The text file has one row per energy [eV] with the rates [1/Mpc] for each redshift of the photon field,
+ a binary table file (see TableFile.h and binaryTableFilename) is used if present
+ and converted from the current text file, otherwise a warning is printed.
+ */
+ref_ptr<const InteractionRateTable> getInteractionRateTable(const std::string &filename, PhotonField photonField);
+
+/**
+ Return the background photon energies in a file of the given photon field, shared as above.
+ The file has one row per cumulative probability with the photon energies [eV] for each redshift.
+ */
+ref_ptr<const PhotonEnergyTable> getPhotonEnergyTable(const std::string &filename, PhotonField photonField);
+
+/**
+ Name of the binary version of a table file, e.g. PP-CMB.txt -> PP-CMB.bin.
+ If the binary version exists, it is mapped instead of parsing the text file.
+ */
+std::string binaryTableFilename(const std::string &filename);
+
+/** Convert a text table of the given photon field and kind to a binary table file */
+void convertInteractionTable(const std::string &textFile, const std::string &tableFile,
+        PhotonField photonField, TableKind kind);
+
 
 } // namespace grpropa
 
@@ -0,0 +1,187 @@
+#ifndef GRPROPA_QUANTIZEDGRID_H
+#define GRPROPA_QUANTIZEDGRID_H
+
+#include "grpropa/Grid.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdint.h>
+
+namespace grpropa {
+
+/**
+ @class QuantizedVectorGrid
+ @brief Read-only vector grid with integer components and a scale per brick
+
+ The grid is encoded once from a VectorGrid, e.g. from a field file mapped
+ with mapVectorGrid, so the full precision field never has to be loaded, or
+ loaded from a quantized dump (dumpGrid / loadGrid in GridTools). The points are stored in bricks
+ of 8^3 points (see BrickedGridLayout), each brick with its own scale:
+ component = q * scale, with scale = max |component| in the brick / max(Q).
+ With Q = int16_t a point takes 6 instead of 12 bytes, with Q = int8_t 3 bytes.
+ The absolute error of a point is at most half a scale, i.e. relative to the
+ strongest component in its brick 1.5e-5 for int16_t and 4e-3 for int8_t.
+
+ The values are decoded on the fly for the trilinear interpolation, which
+ otherwise follows the grid it was encoded from (same geometry, periodic or
+ reflective continuation and weights, see Grid::interpolateCell).
+ */
+template<typename Q>
+class QuantizedVectorGrid: public Referenced {
+    std::vector<Q> values; /**< 3 components per point, bricks of 8^3 points */
+    std::vector<float> scales; /**< Scale of each brick */
+    size_t Nx, Ny, Nz; /**< Number of grid points */
+    size_t By, Bz; /**< Number of bricks in y and z */
+    Vector3d origin;
+    Vector3d gridOrigin;
+    double spacing;
+    bool reflective;
+
+    static const size_t brickBits = 3;
+    static const size_t brickMask = (1 << brickBits) - 1;
+
+    size_t brickIndex(size_t ix, size_t iy, size_t iz) const {
+        return ((ix >> brickBits) * By + (iy >> brickBits)) * Bz + (iz >> brickBits);
+    }
+
+    /** Index of the first component of a point */
+    size_t valueIndex(size_t ix, size_t iy, size_t iz) const {
+        size_t point = ((ix & brickMask) << (2 * brickBits)) | ((iy & brickMask) << brickBits) | (iz & brickMask);
+        return 3 * ((brickIndex(ix, iy, iz) << (3 * brickBits)) | point);
+    }
+
+    /** Allocate the zeroed values and scales */
+    void init() {
+        gridOrigin = origin + Vector3d(spacing / 2);
+        size_t Bx = (Nx + brickMask) >> brickBits;
+        By = (Ny + brickMask) >> brickBits;
+        Bz = (Nz + brickMask) >> brickBits;
+        scales.resize(Bx * By * Bz, 0);
+        values.resize(3 * (scales.size() << (3 * brickBits)), 0);
+    }
+
+public:
+    /** Encode the values of a grid, which can have any layout */
+    QuantizedVectorGrid(const Grid<Vector3f> &grid) :
+            Nx(grid.getNx()), Ny(grid.getNy()), Nz(grid.getNz()),
+            origin(grid.getOrigin()), spacing(grid.getSpacing()),
+            reflective(grid.isReflective()) {
+        init();
+
+        const double qMax = std::numeric_limits<Q>::max();
+        for (size_t ix = 0; ix < Nx; ix++)
+            for (size_t iy = 0; iy < Ny; iy++)
+                for (size_t iz = 0; iz < Nz; iz++) {
+                    const Vector3f &v = grid.get(ix, iy, iz);
+                    float m = std::max(fabs(v.x), std::max(fabs(v.y), fabs(v.z)));
+                    float &s = scales[brickIndex(ix, iy, iz)];
+                    s = std::max(s, float(m / qMax));
+                }
+
+        for (size_t ix = 0; ix < Nx; ix++)
+            for (size_t iy = 0; iy < Ny; iy++)
+                for (size_t iz = 0; iz < Nz; iz++) {
+                    float s = scales[brickIndex(ix, iy, iz)];
+                    if (s == 0)
+                        continue;
+                    const Vector3f &v = grid.get(ix, iy, iz);
+                    Q *q = &values[valueIndex(ix, iy, iz)];
+                    q[0] = Q(std::max(-qMax, std::min(qMax, round(v.x / s))));
+                    q[1] = Q(std::max(-qMax, std::min(qMax, round(v.y / s))));
+                    q[2] = Q(std::max(-qMax, std::min(qMax, round(v.z / s))));
+                }
+    }
+
+    /** Grid of zeros, e.g. to load a quantized dump into (see loadGrid) */
+    QuantizedVectorGrid(Vector3d origin, size_t Nx, size_t Ny, size_t Nz,
+            double spacing) :
+            Nx(Nx), Ny(Ny), Nz(Nz), origin(origin), spacing(spacing),
+            reflective(false) {
+        init();
+    }
+
+    Vector3d getOrigin() const {
+        return origin;
+    }
+
+    size_t getNx() const {
+        return Nx;
+    }
+
+    size_t getNy() const {
+        return Ny;
+    }
+
+    size_t getNz() const {
+        return Nz;
+    }
+
+    double getSpacing() const {
+        return spacing;
+    }
+
+    void setReflective(bool b) {
+        reflective = b;
+    }
+
+    bool isReflective() const {
+        return reflective;
+    }
+
+    /** Memory used by the values and scales in bytes */
+    size_t getMemorySize() const {
+        return values.size() * sizeof(Q) + scales.size() * sizeof(float);
+    }
+
+    /** Components of all points in storage order, see the class description */
+    std::vector<Q> &getValues() {
+        return values;
+    }
+
+    /** Scales of all bricks in storage order */
+    std::vector<float> &getScales() {
+        return scales;
+    }
+
+    /** Decoded value of a grid point */
+    Vector3f getValue(size_t ix, size_t iy, size_t iz) const {
+        const Q *q = &values[valueIndex(ix, iy, iz)];
+        float s = scales[brickIndex(ix, iy, iz)];
+        return Vector3f(q[0] * s, q[1] * s, q[2] * s);
+    }
+
+    /** Interpolate the grid at a given position */
+    Vector3f interpolate(const Vector3d &position) const {
+        Vector3d r = (position - gridOrigin) / spacing;
+
+        // indices of lower and upper neighbors
+        int ix, iX, iy, iY, iz, iZ;
+        if (reflective) {
+            reflectiveClamp(r.x, Nx, ix, iX);
+            reflectiveClamp(r.y, Ny, iy, iY);
+            reflectiveClamp(r.z, Nz, iz, iZ);
+        } else {
+            periodicClamp(r.x, Nx, ix, iX);
+            periodicClamp(r.y, Ny, iy, iY);
+            periodicClamp(r.z, Nz, iz, iZ);
+        }
+
+        Vector3f corner[8];
+        corner[0] = getValue(ix, iy, iz);
+        corner[1] = getValue(iX, iy, iz);
+        corner[2] = getValue(ix, iY, iz);
+        corner[3] = getValue(ix, iy, iZ);
+        corner[4] = getValue(iX, iy, iZ);
+        corner[5] = getValue(ix, iY, iZ);
+        corner[6] = getValue(iX, iY, iz);
+        corner[7] = getValue(iX, iY, iZ);
+        return Grid<Vector3f>::interpolateCell(corner, r);
+    }
+};
+
+typedef QuantizedVectorGrid<int16_t> QuantizedVectorGrid16;
+typedef QuantizedVectorGrid<int8_t> QuantizedVectorGrid8;
+
+} // namespace grpropa
+
+#endif // GRPROPA_QUANTIZEDGRID_H
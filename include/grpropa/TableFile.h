@@ -0,0 +1,90 @@
+#ifndef GRPROPA_TABLEFILE_H
+#define GRPROPA_TABLEFILE_H
+
+#include "grpropa/Referenced.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace grpropa {
+
+/**
+ Binary table files, version 2
+
+ A 128 byte header is followed by three arrays of doubles: the row axis
+ (nRows), the redshift axis (nRedshifts) and the values
+ (max(nRedshifts, 1) * nRows, value of row j at redshift i at i * nRows + j).
+ All values are in SI units, the header names the quantities and units.
+ The arrays start at multiples of 8 bytes, so a mapped file can be read in place.
+ Numbers are stored in the byte order of the machine that wrote the file,
+ files with another byte order are rejected. A table converted from a text
+ file records the size and modification time of that file, so outdated
+ tables can be detected (see TableFile::isUpToDate).
+ */
+struct TableFileHeader {
+    char magic[8]; /**< "GRPTABLE" */
+    uint32_t version; /**< format version, currently 2 */
+    uint32_t kind; /**< what the values are, see TableKind */
+    uint64_t nRows; /**< number of nodes of the row axis */
+    uint64_t nRedshifts; /**< number of redshifts, 0 if redshift independent */
+    char rowAxis[16]; /**< name of the row axis, e.g. "energy" */
+    char rowUnit[16]; /**< unit of the row axis, e.g. "J" */
+    char valueName[16]; /**< name of the values, e.g. "rate" */
+    char valueUnit[16]; /**< unit of the values, e.g. "1/m" */
+    uint32_t byteOrder; /**< 0x01020304 in the byte order of the file */
+    uint32_t reserved1;
+    uint64_t sourceSize; /**< size of the text file it was converted from [bytes], 0 if none */
+    int64_t sourceTime; /**< modification time of that file [s since 1970] */
+    char reserved[8];
+};
+
+enum TableKind {
+    InteractionRateTableKind = 1, /**< energy [J] -> interaction rate [1/m] */
+    PhotonEnergyTableKind = 2 /**< cumulative probability -> photon energy [J] */
+};
+
+/**
+ @class TableFile
+ @brief Read-only memory mapping of a binary table file
+
+ Opening the file only maps it and validates the header against the file size;
+ the arrays are used in place without any parsing.
+ */
+class TableFile: public Referenced {
+    int fd;
+    void *data;
+    size_t length;
+    const TableFileHeader *header;
+public:
+    TableFile(const std::string &filename);
+    ~TableFile();
+
+    const TableFileHeader &getHeader() const;
+    TableKind getKind() const;
+    size_t getRowCount() const;
+    size_t getRedshiftCount() const;
+
+    const double *getRows() const;
+    const double *getRedshifts() const;
+    const double *getValues() const;
+
+    /** Check if the table was converted from sourceFile as it is now (same size and modification time) */
+    bool isUpToDate(const std::string &sourceFile) const;
+};
+
+/** Check if a file starts with the table file magic */
+bool isTableFile(const std::string &filename);
+
+/**
+ Write a binary table file, see TableFileHeader.
+ values has max(redshifts.size(), 1) * rows.size() entries.
+ sourceFile is the text file the table was converted from, if any.
+ */
+void writeTableFile(const std::string &filename, TableKind kind,
+        const std::vector<double> &rows, const std::vector<double> &redshifts,
+        const std::vector<double> &values, const std::string &sourceFile = "");
+
+} // namespace grpropa
+
+#endif // GRPROPA_TABLEFILE_H
@@ -0,0 +1,62 @@
+#ifndef GRPROPA_THREADSLOTS_H
+#define GRPROPA_THREADSLOTS_H
+
+#include <stddef.h>
+
+namespace grpropa {
+
+/** Number of threads with their own slot, see ThreadSlots and Random::instance */
+const int MAX_THREAD = 256;
+
+/**
+ Slot of the calling thread, or -1 if it has to use shared state instead.
+ Every thread, OpenMP or not, gets a slot of its own on its first call, the
+ slot of an ended thread is given to the next new one. Threads started while
+ MAX_THREAD others hold a slot get none. The OpenMP thread number is not used,
+ as other host threads, e.g. of Python, and nested parallel regions repeat it.
+ */
+int threadSlot();
+
+/**
+ @class ThreadSlots
+ @brief Per-thread copies of some state, e.g. output buffers or caches
+
+ Every copy is padded to a multiple of 64 bytes, so the threads do not
+ share cache lines. Threads without a slot of their own (see threadSlot)
+ use the shared copy, which the caller has to guard, e.g. with a named
+ omp critical section. Without user declared constructors, slots of plain
+ types in static storage are zero-initialized before any code runs.
+ */
+template<class T>
+class ThreadSlots {
+    struct Slot {
+        T value;
+        char padding[64 - sizeof(T) % 64];
+    };
+    Slot slots[MAX_THREAD + 1]; // the last one is shared
+public:
+    /** Copy of the calling thread, NULL if the shared copy has to be used */
+    T *local() {
+        int i = threadSlot();
+        if (i < 0)
+            return NULL;
+        return &slots[i].value;
+    }
+
+    T &shared() {
+        return slots[MAX_THREAD].value;
+    }
+
+    /** All copies, including the shared one, e.g. to merge them outside of parallel regions */
+    T &operator[](size_t i) {
+        return slots[i].value;
+    }
+
+    size_t size() const {
+        return MAX_THREAD + 1;
+    }
+};
+
+} // namespace grpropa
+
+#endif // GRPROPA_THREADSLOTS_H
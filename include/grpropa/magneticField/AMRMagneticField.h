@@ -27,6 +27,9 @@ namespace grpropa {
 /**
  @class AMRMagneticField
  @brief Wrapper for saga::MagneticField
+
+ The saga field is not thread safe, so all queries are serialized.
+ For parallel runs take a snapshot with OctreeMagneticField.
  */
 class AMRMagneticField: public MagneticField {
 
@@ -69,6 +72,21 @@ public:
         return Vector3d(b[0], b[1], b[2]) * tesla;   
     }
 
+    // the saga field is not thread safe, lock it once for all positions
+    void getFields(const double *xyz, double *out, size_t n) const {
+        #ifdef _OPENMP
+            #pragma omp critical
+        #endif
+        {
+            for (size_t i = 0; i < n; i++) {
+                const double *p = xyz + 3 * i;
+                std::vector<double> b = field->getField(p[0] / cfLength, p[1] / cfLength, p[2] / cfLength);
+                for (int j = 0; j < 3; j++)
+                    out[3 * i + j] = b[j] * cfMagneticField * tesla;
+            }
+        }
+    }
+
 };
 
 } // namespace grpropa
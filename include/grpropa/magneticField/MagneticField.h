@@ -15,6 +15,16 @@ public:
     virtual ~MagneticField() {
     }
     virtual Vector3d getField(const Vector3d &position) const = 0;
+
+    /**
+     Calculates the magnetic field at n positions.
+     The default calls getField for each position; fields that can share work
+     between positions override it.
+     @param xyz     positions as x0, y0, z0, x1, ...
+     @param out     fields, same layout as xyz
+     @param n       number of positions
+     */
+    virtual void getFields(const double *xyz, double *out, size_t n) const;
 };
 
 /**
@@ -25,6 +35,7 @@ class PeriodicMagneticField: public MagneticField {
     ref_ptr<MagneticField> field;
     Vector3d origin, extends;
     bool reflective;
+    Vector3d mapPosition(const Vector3d &position) const;
 public:
     PeriodicMagneticField(ref_ptr<MagneticField> field, const Vector3d &extends);
     PeriodicMagneticField(ref_ptr<MagneticField> field, const Vector3d &extends, const Vector3d &origin, bool reflective);
@@ -35,6 +46,7 @@ public:
     bool isReflective();
     void setReflective(bool reflective);
     Vector3d getField(const Vector3d &position) const;
+    void getFields(const double *xyz, double *out, size_t n) const;
 };
 
 /**
@@ -46,6 +58,7 @@ class MagneticFieldList: public MagneticField {
 public:
     void addField(ref_ptr<MagneticField> field);
     Vector3d getField(const Vector3d &position) const;
+    void getFields(const double *xyz, double *out, size_t n) const;
 };
 
 /**
@@ -61,6 +74,13 @@ public:
     Vector3d getField(const Vector3d &position) const {
         return value;
     }
+    void getFields(const double *xyz, double *out, size_t n) const {
+        for (size_t i = 0; i < n; i++) {
+            out[3 * i] = value.x;
+            out[3 * i + 1] = value.y;
+            out[3 * i + 2] = value.z;
+        }
+    }
 };
 
 } // namespace grpropa
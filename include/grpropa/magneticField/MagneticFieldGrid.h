@@ -3,6 +3,7 @@
 
 #include "grpropa/magneticField/MagneticField.h"
 #include "grpropa/Grid.h"
+#include "grpropa/QuantizedGrid.h"
 
 namespace grpropa {
 
@@ -19,6 +20,9 @@ public:
     void setGrid(ref_ptr<VectorGrid> grid);
     ref_ptr<VectorGrid> getGrid();
     Vector3d getField(const Vector3d &position) const;
+    void getFields(const double *xyz, double *out, size_t n) const;
+    /** Field at position, reusing the cell of the cursor if possible (see GridCursor) */
+    Vector3d getField(const Vector3d &position, VectorGridCursor &cursor) const;
 };
 
 /**
@@ -42,8 +46,48 @@ public:
     ref_ptr<ScalarGrid> getModulationGrid();
     void setReflective(bool gridReflective, bool modGridReflective);
     Vector3d getField(const Vector3d &position) const;
+    void getFields(const double *xyz, double *out, size_t n) const;
 };
 
+/**
+ @class QuantizedMagneticFieldGrid
+ @brief Magnetic field on a quantized grid with trilinear interpolation.
+
+ This class wraps a QuantizedVectorGrid16 or QuantizedVectorGrid8 to serve as
+ a MagneticField, at a half or a quarter of the memory of a VectorGrid.
+ See quantizationError in GridTools.h for the deviation from the original grid.
+ */
+template<typename Q>
+class QuantizedMagneticFieldGrid: public MagneticField {
+    ref_ptr<QuantizedVectorGrid<Q> > grid;
+public:
+    QuantizedMagneticFieldGrid(ref_ptr<QuantizedVectorGrid<Q> > grid) :
+            grid(grid) {
+    }
+    void setGrid(ref_ptr<QuantizedVectorGrid<Q> > grid) {
+        this->grid = grid;
+    }
+    ref_ptr<QuantizedVectorGrid<Q> > getGrid() {
+        return grid;
+    }
+    Vector3d getField(const Vector3d &position) const {
+        return grid->interpolate(position);
+    }
+    void getFields(const double *xyz, double *out, size_t n) const {
+        const QuantizedVectorGrid<Q> &g = *grid;
+        for (size_t i = 0; i < n; i++) {
+            const double *p = xyz + 3 * i;
+            Vector3f b = g.interpolate(Vector3d(p[0], p[1], p[2]));
+            out[3 * i] = b.x;
+            out[3 * i + 1] = b.y;
+            out[3 * i + 2] = b.z;
+        }
+    }
+};
+
+typedef QuantizedMagneticFieldGrid<int16_t> QuantizedMagneticFieldGrid16;
+typedef QuantizedMagneticFieldGrid<int8_t> QuantizedMagneticFieldGrid8;
+
 } // namespace grpropa
 
 #endif // GRPROPA_MAGNETICFIELDGRID_H
@@ -0,0 +1,66 @@
+#ifndef GRPROPA_OCTREEMAGNETICFIELD_H
+#define GRPROPA_OCTREEMAGNETICFIELD_H
+
+#include "grpropa/magneticField/MagneticField.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace grpropa {
+
+/**
+ @class OctreeMagneticField
+ @brief Read-only octree of cells with a constant field, e.g. a snapshot of an AMR field
+
+ The octree covers a cube and is built once at construction by sampling
+ another field at the cell centers. A cell is refined when the field at the
+ centers of its 8 children deviates from the field at its own center by more
+ than the tolerance times the larger of the field strength there and
+ minStrength, down to maxDepth. With the cube and maxDepth of an AMR grid and
+ a tolerance of 0 (e.g. for an AMRMagneticField) the leaves are the AMR cells,
+ so the snapshot reproduces the AMR field.
+
+ Queries only descend the tree: they are thread safe, lock free and do not
+ allocate, so unlike AMRMagneticField the snapshot scales with the number of
+ threads. Outside the cube the field is zero.
+ */
+class OctreeMagneticField: public MagneticField {
+    struct Node {
+        int32_t child; /**< Index of the first of 8 children, -1 for leaves */
+        float field[3]; /**< Field at the cell center */
+    };
+    std::vector<Node> nodes; /**< Depth-first, the 8 children of a node are contiguous */
+    Vector3d origin;
+    double size;
+    int maxDepth;
+
+    void build(ref_ptr<MagneticField> field, size_t node, const Vector3d &center,
+            int depth, int minDepth, double tolerance, double minStrength);
+    size_t findLeaf(const Vector3d &position) const;
+public:
+    /**
+     Sample a field into an octree.
+     @param field       field to sample, only used during construction
+     @param origin      lower corner of the cube
+     @param size        edge length of the cube
+     @param maxDepth    maximum number of refinements, at most 30
+     @param minDepth    number of refinements of every cell, to not miss small structures
+     @param tolerance   relative deviation that refines a cell
+     @param minStrength field strength below which the deviation is taken as absolute
+     */
+    OctreeMagneticField(ref_ptr<MagneticField> field, const Vector3d &origin,
+            double size, int maxDepth, int minDepth = 0, double tolerance = 1e-3,
+            double minStrength = 0);
+
+    Vector3d getOrigin() const;
+    double getSize() const;
+    int getMaxDepth() const;
+    size_t getNodeCount() const;
+
+    Vector3d getField(const Vector3d &position) const;
+    void getFields(const double *xyz, double *out, size_t n) const;
+};
+
+} // namespace grpropa
+
+#endif // GRPROPA_OCTREEMAGNETICFIELD_H
@@ -64,6 +64,7 @@ private:
     double margin;
     std::string flag;
     std::string flagValue;
+    PropertyKey flagKey, flagValueKey;
     bool limitStep;
 
 public:
@@ -93,6 +94,7 @@ private:
     double margin;
     std::string flag;
     std::string flagValue;
+    PropertyKey flagKey, flagValueKey;
     bool limitStep;
 
 public:
@@ -123,6 +125,7 @@ private:
     double margin;
     std::string flag;
     std::string flagValue;
+    PropertyKey flagKey, flagValueKey;
     bool limitStep;
 
 public:
@@ -16,6 +16,8 @@ namespace grpropa {
 class MaximumTrajectoryLength: public Module {
     double maxLength;
     std::string flag;
+    PropertyKey flagKey, descriptionKey; // interned flag and description
+    void updateKeys();
 public:
     MaximumTrajectoryLength(double length = 0, std::string flag = "Deactivated");
     void setMaximumTrajectoryLength(double length);
@@ -36,6 +38,8 @@ public:
 class MinimumEnergy: public Module {
     double minEnergy;
     std::string flag;
+    PropertyKey flagKey, descriptionKey; // interned flag and description
+    void updateKeys();
 public:
     MinimumEnergy(double minEnergy = 0, std::string flag = "Deactivated");
     void setMinimumEnergy(double energy);
@@ -56,6 +60,8 @@ public:
 class MinimumRedshift: public Module {
     double zmin;
     std::string flag;
+    PropertyKey flagKey, descriptionKey; // interned flag and description
+    void updateKeys();
 public:
     MinimumRedshift(double zmin = 0, std::string flag = "Deactivated");
     void setMinimumRedshift(double z);
@@ -24,11 +24,8 @@ class InverseCompton: public Module {
 private:
     PhotonField photonField;
 
-    std::vector<double> tabEnergy; /* tabulated energy [eV] */
-    std::vector<double> tabRate; /* tabulated rate [1/Mpc] */
-    std::vector<double> tabRedshift; /* tabulated redshifts for z dependence of the IRB */
-    std::vector<double> tabPhotonEnergy; /* background photon energy*/
-    std::vector<double> tabProb; /* cumulative probability for background photon. */
+    ref_ptr<const InteractionRateTable> rateTable; /* tabulated rates, shared with other modules */
+    ref_ptr<const PhotonEnergyTable> photonTable; /* background photon energies, shared with other modules */
 
     double limit; /* fraction of energy loss length to limit the next step */
     bool redshiftDependence;
@@ -1,14 +1,15 @@
 #ifndef GRPROPA_OBSERVER_H
 #define GRPROPA_OBSERVER_H
 
-#include <fstream>
 #include <limits>
 #include <string>
 #include <vector>
 
 #include "../Candidate.h"
 #include "../Module.h"
+#include "../OutputWriter.h"
 #include "../Referenced.h"
+#include "../ThreadSlots.h"
 #include "../Vector3.h"
 
 namespace grpropa {
@@ -27,6 +28,8 @@ protected:
 public:
     virtual DetectionState checkDetection(Candidate *candidate) const;
     virtual void onDetection(Candidate *candidate) const;
+    /** Called at the end of a run, see Module::endRun */
+    virtual void endRun();
     virtual std::string getDescription() const;
 };
 
@@ -38,10 +41,14 @@ class Observer: public Module {
 private:
     std::vector<ref_ptr<ObserverFeature> > features;
     bool makeInactive;
+    PropertyKey flagKey, flagValueKey;
 public:
     Observer(bool makeInactive = true);
     void add(ObserverFeature *property);
+    /** Set a property on detected candidates, e.g. for TrajectoryOutput::setDetectionProperty */
+    void setFlag(std::string flag, std::string flagValue);
     void process(Candidate *candidate) const;
+    void endRun();
     std::string getDescription() const;
 };
 
@@ -134,11 +141,12 @@ public:
  */
 class ObserverOutput3D: public ObserverFeature {
 private:
-    mutable std::ofstream fout;
+    ref_ptr<OutputWriter> out;
 public:
     ObserverOutput3D(std::string filename);
-    ~ObserverOutput3D();
     void onDetection(Candidate *candidate) const;
+    void endRun();
+    void close();
 };
 
 /**
@@ -147,11 +155,99 @@ public:
  */
 class ObserverOutput1D: public ObserverFeature {
 private:
-    mutable std::ofstream fout;
+    ref_ptr<OutputWriter> out;
 public:
     ObserverOutput1D(std::string filename);
-    ~ObserverOutput1D();
     void onDetection(Candidate *candidate) const;
+    void endRun();
+    void close();
+};
+
+/** Columns of ObserverColumnOutput, to be combined with | */
+enum ObserverColumns {
+    TrajectoryLengthColumn = 1 << 0, /**< D [Mpc] */
+    IdColumn = 1 << 1, /**< ID */
+    SourceIdColumn = 1 << 2, /**< ID0 */
+    EnergyColumn = 1 << 3, /**< E [EeV] */
+    SourceEnergyColumn = 1 << 4, /**< E0 [EeV] */
+    PositionColumns = 1 << 5, /**< X, Y, Z [Mpc] */
+    SourcePositionColumns = 1 << 6, /**< X0, Y0, Z0 [Mpc] */
+    DirectionColumns = 1 << 7, /**< Px, Py, Pz */
+    SourceDirectionColumns = 1 << 8, /**< P0x, P0y, P0z */
+    RedshiftColumn = 1 << 9, /**< z */
+    AllColumns = (1 << 10) - 1
+};
+
+/**
+ @class ObserverColumnOutput
+ @brief Binary output of 3D properties in columns
+
+ The file starts with a header that describes the selected columns,
+ followed by blocks of up to blockRows detections. Within a block every
+ column is stored contiguously, so a column can be memory mapped without
+ parsing (see python/grpropa/columns.py). All values are little-endian:
+ the IDs as int32, the other columns as float64 or, if singlePrecision is
+ set, float32. Columns that are not selected are not written at all.
+
+ Header (all sizes in bytes):
+   char[8]    magic "GRPCOLS"
+   uint32     format version (1)
+   uint32     number of columns
+   uint32     blockRows
+   uint32     size of the header, including the column descriptions
+   per column: char[16] name, char[8] numpy type (e.g. "<f8"), char[8] unit
+ Block:
+   uint32     number of rows n
+   uint32     reserved
+   per column: n values, padded with zeros to a multiple of 8 bytes
+
+ Every thread fills its own block, which is written with a single write
+ when it is full. The remaining rows are written in shorter blocks by
+ endRun and close. A filename ending in .gz compresses the file (see
+ OutputWriter); it then has to be decompressed before it can be mapped.
+ */
+class ObserverColumnOutput: public ObserverFeature {
+private:
+    struct Column {
+        std::string name;
+        std::string type;
+        std::string unit;
+        int quantity; /**< Index into the values computed in onDetection */
+        bool integer; /**< int32 or floating point */
+        size_t size; /**< Bytes per value */
+        size_t offset; /**< Offset of the column in a full block */
+    };
+    struct Block {
+        std::vector<char> data;
+        size_t rows;
+        Block() : rows(0) {
+        }
+    };
+    ref_ptr<OutputWriter> out;
+    std::vector<Column> columns;
+    size_t blockRows;
+    size_t blockSize; /**< Bytes of a full block */
+    mutable ThreadSlots<Block> blocks;
+    bool closed;
+
+    void addColumn(const std::string &name, const std::string &unit,
+            int quantity, bool integer, bool singlePrecision);
+    void append(Block &block, const double *values) const;
+    void writeBlock(Block &block) const;
+    void writeBlocks();
+public:
+    /**
+     @param filename        file to create
+     @param columns         selected columns, see ObserverColumns
+     @param singlePrecision store floating point columns as float32
+     @param blockRows       maximum number of rows per block
+     */
+    ObserverColumnOutput(std::string filename, int columns = AllColumns,
+            bool singlePrecision = false, size_t blockRows = 1 << 16);
+    ~ObserverColumnOutput();
+    void onDetection(Candidate *candidate) const;
+    void endRun();
+    void close();
 };
 
 
@@ -0,0 +1,113 @@
+#ifndef GRPROPA_OBSERVERHISTOGRAM_H
+#define GRPROPA_OBSERVERHISTOGRAM_H
+
+#include "grpropa/module/Observer.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace grpropa {
+
+/** Quantities of detected particles that can be histogrammed */
+enum HistogramQuantity {
+    EnergyQuantity, /**< Energy [J] */
+    SourceEnergyQuantity, /**< Energy at the source [J] */
+    DeflectionQuantity, /**< Angle between the momentum and the line from the source [rad] */
+    TimeDelayQuantity, /**< Delay with respect to a straight line from the source [s] */
+    SourceIdQuantity, /**< Particle type at the source */
+    ArrivalPixelQuantity /**< HEALPix pixel of the arrival direction */
+};
+
+/**
+ @class HistogramAxis
+ @brief Binning of one quantity of an ObserverHistogram
+
+ Values outside of [min, max) are not counted.
+ */
+class HistogramAxis {
+    HistogramQuantity quantity;
+    size_t nBins;
+    double min, max;
+    bool logarithmic;
+    int nside;
+public:
+    /**
+     Linear or logarithmic bins, in the units of the quantity (SI).
+     */
+    HistogramAxis(HistogramQuantity quantity, size_t nBins, double min,
+            double max, bool logarithmic = false);
+    /**
+     HEALPix pixels of the direction the particles arrive from (the opposite
+     of their momentum), in RING ordering with the z-axis as the pole and
+     the longitude measured from the x-axis towards the y-axis.
+     @param nside   HEALPix resolution parameter, 12 nside^2 pixels
+     */
+    explicit HistogramAxis(int nside);
+
+    HistogramQuantity getQuantity() const;
+    size_t getBinCount() const;
+    /** Lower edge of bin i, i = getBinCount() for the upper edge of the last bin */
+    double getEdge(size_t i) const;
+    /** Bin of the quantity of a candidate, -1 if out of range */
+    long getBin(const Candidate *candidate) const;
+};
+
+/**
+ @class ObserverHistogram
+ @brief Weighted 1D or 2D histogram of detected particles
+
+ Instead of writing the detected particles, an observer can histogram them
+ directly, e.g. into spectra or arrival direction maps. Every thread fills
+ its own copy, the copies are added up by endRun at the end of each run, so
+ the results (getValues, save) are available after ModuleList::endRun, i.e.
+ after a run over candidates or a source, and accumulate over runs.
+
+ Every particle is counted with a weight of 1, multiplied by
+ (E0 / referenceEnergy)^alpha with setSourceSpectrumWeight (to reweight the
+ injected spectrum) and by the weight of its source particle type with
+ setSourceIdWeight.
+ */
+class ObserverHistogram: public ObserverFeature {
+private:
+    struct Bins {
+        std::vector<double> sum; /**< Sum of the weights, then of their squares */
+    };
+    std::vector<HistogramAxis> axes;
+    size_t nBins;
+    mutable ThreadSlots<Bins> bins;
+    std::vector<double> values;
+    std::vector<double> squares;
+
+    double alpha, referenceEnergy;
+    std::map<int, double> sourceIdWeights;
+
+    void init();
+    void fill(Bins &bins, size_t bin, double weight) const;
+public:
+    ObserverHistogram(const HistogramAxis &x);
+    ObserverHistogram(const HistogramAxis &x, const HistogramAxis &y);
+
+    /** Weight particles by (E0 / referenceEnergy)^alpha */
+    void setSourceSpectrumWeight(double alpha, double referenceEnergy);
+    /** Weight particles by the type they had at the source */
+    void setSourceIdWeight(int id, double weight);
+
+    void onDetection(Candidate *candidate) const;
+    void endRun();
+
+    size_t getDimension() const;
+    const HistogramAxis &getAxis(size_t i) const;
+    /** Sum of the weights per bin, index ix * ny + iy for 2D histograms */
+    const std::vector<double> &getValues() const;
+    /** Statistical uncertainty per bin, the square root of the sum of the squared weights */
+    std::vector<double> getUncertainties() const;
+    void clear();
+
+    /** Write the bin edges, values and uncertainties as plain text */
+    void save(const std::string &filename) const;
+};
+
+} // namespace grpropa
+
+#endif // GRPROPA_OBSERVERHISTOGRAM_H
@@ -3,21 +3,60 @@
 
 #include "grpropa/Module.h"
 #include "grpropa/AssocVector.h"
-
-#include <fstream>
+#include "grpropa/OutputWriter.h"
 
 namespace grpropa {
 
 /**
  @class TrajectoryOutput
  @brief Saves trajectories to plain text file.
+
+ By default every step of every particle is written. To reduce the output,
+ only every n-th step, or only steps after which the direction has turned
+ by more than an angle or the particle has moved by more than a distance
+ since the last written step, can be written instead. The first step of
+ every particle is always written, and so is its last step if the particle
+ has been deactivated before this module.
+
+ setSampling keeps a random fraction of the primaries together with all
+ their secondaries. Whether a primary is kept is a hash of its source state
+ and the sampling seed, not a draw from Random::instance(), so that the
+ simulation itself does not change with the sampling, and a primary is kept
+ or dropped independently of the thread that propagates it. With setDetectionProperty the steps of a cascade are
+ held in memory and only written, in one piece, when one of its particles
+ has been flagged with that property, e.g. by Observer::setFlag. The module
+ then has to come after the flagging module. A cascade is written when its
+ last particle has been released, or at the end of the run (endRun) or on
+ close if the caller still holds its particles; steps that are added later
+ follow as a separate piece.
  */
 class TrajectoryOutput: public Module {
-    mutable std::ofstream fout;
+    ref_ptr<OutputWriter> out;
+    size_t stepInterval;
+    double minAngle;
+    double minDistance;
+    double sampling;
+    unsigned int samplingSeed;
+    PropertyKey detectionKey;
+    ref_ptr<Referenced> cascades; /**< Cascades that have not been released */
+
+    bool recording() const;
+    size_t format(Candidate *candidate, char *buffer) const;
 public:
     TrajectoryOutput(std::string filename);
-    ~TrajectoryOutput();
+    /** Write only every n-th step of a particle */
+    void setStepInterval(size_t n);
+    /** Write a step if the direction has turned by more than this angle [rad] since the last written step */
+    void setMinAngle(double angle);
+    /** Write a step if the particle has moved by more than this distance since the last written step */
+    void setMinDistance(double distance);
+    /** Fraction of primaries whose cascades are written, chosen by the seed */
+    void setSampling(double fraction, unsigned int seed = 0);
+    /** Write only cascades in which a particle gets this property, none to write all */
+    void setDetectionProperty(std::string property);
     void process(Candidate *candidate) const;
+    void endRun();
+    void close();
 };
 
 /**
@@ -25,12 +64,14 @@ public:
  @brief Saves particles with a given property to a plain text file.
  */
 class ConditionalOutput: public Module {
-    mutable std::ofstream fout;
+    ref_ptr<OutputWriter> out;
     std::string condition;
+    PropertyKey conditionKey;
 public:
     ConditionalOutput(std::string filename, std::string condition = "Detected");
-    ~ConditionalOutput();
     void process(Candidate *candidate) const;
+    void endRun();
+    void close();
 };
 
 /**
@@ -38,11 +79,12 @@ public:
  @brief Saves 1D trajectories to plain text file.
  */
 class TrajectoryOutput1D: public Module {
-    mutable std::ofstream fout;
+    ref_ptr<OutputWriter> out;
 public:
     TrajectoryOutput1D(std::string filename);
-    ~TrajectoryOutput1D();
     void process(Candidate *candidate) const;
+    void endRun();
+    void close();
 };
 
 /**
@@ -50,11 +92,13 @@ public:
  @brief Records particles that are inactive and have the property 'Detected' to a plain text file.
  */
 class EventOutput1D: public Module {
-    mutable std::ofstream fout;
+    ref_ptr<OutputWriter> out;
+    PropertyKey detectedKey;
 public:
     EventOutput1D(std::string filename);
-    ~EventOutput1D();
     void process(Candidate *candidate) const;
+    void endRun();
+    void close();
 };
 
 } // namespace grpropa
@@ -4,21 +4,42 @@
 #include "grpropa/Module.h"
 #include "grpropa/Units.h"
 #include "grpropa/magneticField/MagneticField.h"
+#include "grpropa/Grid.h"
 
 namespace grpropa {
 
+class MagneticFieldGrid;
+
 /**
  @class PropagationCK
- @brief Propagation through magnetic fields using the Cash-Karp method.
+ @brief Propagation through magnetic fields using an embedded Runge-Kutta method.
 
  This module solves the equations of motion of a relativistic charged particle when propagating through a magnetic field.\n
- It uses the Runge-Kutta integration method with Cash-Karp coefficients.\n
+ It uses the Runge-Kutta integration method with Cash-Karp coefficients by default.
+ Alternatively the Dormand-Prince 5(4) or the Bogacki-Shampine 3(2) method can be selected.
+ Both evaluate their last stage at the end point of the step; the field there is
+ kept and reused for the first stage of the next step (first same as last), so they
+ need 6 and 3 field evaluations per accepted step, compared to 6 for Cash-Karp.
+ The first stage is also shared by all tries of a step.
+ For a MagneticFieldGrid the stages of a step share a GridCursor, so stages in
+ the same cell reuse its corner values.\n
  The step size control tries to keep the relative error close to, but smaller than the designated tolerance.
  Additionally a minimum and maximum size for the steps can be set.
  For neutral particles a rectilinear propagation is applied and a next step of the maximum step size proposed.
+
+ Batches of candidates (see ModuleList::setBatchSize) are integrated in lanes of
+ up to 16 charged particles. The phase points of a lane group are kept as
+ structure of arrays, every stage evaluates the field for all lanes with one
+ MagneticField::getFields call, and lanes whose step is accepted are masked
+ while the others retry with a smaller step. The results are the same as
+ integrating the candidates one by one.
  */
 class PropagationCK: public Module {
 public:
+    enum Method {
+        CashKarp, DormandPrince, BogackiShampine
+    };
+
     class Y {
     public:
         Vector3d x, u; /*< phase-point: position and direction */
@@ -46,15 +67,32 @@ public:
     };
 
 private:
-    std::vector<double> a, b, bs; /*< Cash-Karp coefficients */
+    Method method; /*< Runge-Kutta method */
     ref_ptr<MagneticField> field;
+    const MagneticFieldGrid *gridField; /*< field, if it is a grid */
     double tolerance; /*< target relative error of the numerical integration */
     double minStep; /*< minimum step size of the propagation */
     double maxStep; /*< maximum step size of the propagation */
 
+    // fields at n positions, position i uses the cursor of lane lanes[i] (or i)
+    void getFieldsAt(const double *xyz, double *B, size_t n, VectorGridCursor *cursors, const size_t *lanes) const;
+    // one step of a charged candidate with the Butcher tableau T
+    template<class T> void step(Candidate *candidate) const;
+    // one step of up to 16 charged candidates in lockstep, the first of them is the first-th charged candidate of the batch
+    template<class T> void stepLanes(Candidate **candidates, size_t n, size_t first) const;
+    // stepLanes with the tableau of the method
+    void stepCharged(Candidate **candidates, size_t n, size_t first) const;
+
 public:
     PropagationCK(ref_ptr<MagneticField> field = NULL, double tolerance = 1e-4, double minStep = 0.1 * kpc, double maxStep = 1 * Gpc);
     void process(Candidate *candidate) const;
+    void process(Candidate **candidates, size_t n) const;
+
+    /**
+     Field at a position, zero (with a message) if the field throws, also
+     used by PropagationHelix. The cursor speeds up lookups in a field grid.
+     */
+    Vector3d getFieldAt(const Vector3d &position, VectorGridCursor &cursor) const;
 
     // derivative of phase point, dY/dt = d/dt(x, u) = (v, du/dt)
     // du/dt = q*c^2/E * (u x B)
@@ -62,6 +100,8 @@ public:
 
     void tryStep(const Y &y, Y &out, Y &error, double t, ParticleState &p) const;
 
+    void setMethod(Method method);
+    Method getMethod() const;
     void setField(ref_ptr<MagneticField> field);
     void setTolerance(double tolerance);
     void setMinimumStep(double minStep);
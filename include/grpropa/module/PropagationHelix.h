@@ -0,0 +1,79 @@
+#ifndef GRPROPA_PROPAGATIONHELIX_H
+#define GRPROPA_PROPAGATIONHELIX_H
+
+#include "grpropa/Module.h"
+#include "grpropa/Units.h"
+#include "grpropa/magneticField/MagneticField.h"
+#include "grpropa/module/PropagationCK.h"
+
+namespace grpropa {
+
+/**
+ @class PropagationHelix
+ @brief Propagation along analytic helices in locally uniform magnetic fields.
+
+ In a constant field a relativistic charged particle moves on an exact helix.
+ This module evaluates the field at the start of the step, moves the particle
+ along the helix of that field and evaluates the field again at the end point.
+ The change of the field over the step, relative to the field and multiplied
+ with the deflection angle, estimates the direction error of a helix step.
+ If it is below the uniformity tolerance the step is accepted, taking the helix
+ of the mean field; this needs two field evaluations per step. Otherwise the
+ step is handed to PropagationCK.\n
+ The next step is scaled so that the estimate stays close to the tolerance.\n
+ For a MagneticFieldGrid (or ModulatedMagneticFieldGrid) the steps are also
+ limited to end at the next boundary of the interpolation cell along the
+ current direction, so the field along a step comes from one set of grid points.
+ Steps starting within 1% of a cell size from a boundary continue to the
+ following one.\n
+ For neutral particles a rectilinear propagation is applied and a next step of the maximum step size proposed.
+ */
+class PropagationHelix: public Module {
+    ref_ptr<MagneticField> field;
+    ref_ptr<PropagationCK> fallback; /*< for non-uniform fields */
+    double uniformity; /*< allowed relative field change times deflection angle over a step */
+    double minStep; /*< minimum step size of the propagation */
+    double maxStep; /*< maximum step size of the propagation */
+    bool useCells; /*< limit the steps to the cells of a field grid */
+    Vector3d cellOrigin; /*< corner of the interpolation cell (0, 0, 0) */
+    double cellSize;
+
+    // distance to the next cell boundary along the direction
+    double distanceToCellBoundary(const Vector3d &position, const Vector3d &direction) const;
+
+public:
+    /**
+     @param field       magnetic field
+     @param uniformity  allowed relative field change times deflection angle of a helix step
+     @param tolerance   target relative error of the Cash-Karp fallback
+     @param minStep     minimum step size
+     @param maxStep     maximum step size
+     */
+    PropagationHelix(ref_ptr<MagneticField> field, double uniformity = 1e-4, double tolerance = 1e-4,
+            double minStep = 0.1 * kpc, double maxStep = 1 * Gpc);
+    void process(Candidate *candidate) const;
+
+    /**
+     Move a particle along the helix in the uniform field B.
+     @param position    start position, replaced by the end position
+     @param direction   unit start direction, replaced by the end direction
+     @param qc          charge * c_light / energy of the particle
+     */
+    static void moveOnHelix(Vector3d &position, Vector3d &direction, double step, double qc, const Vector3d &B);
+
+    void setField(ref_ptr<MagneticField> field);
+    void setUniformity(double uniformity);
+    void setTolerance(double tolerance);
+    void setMinimumStep(double minStep);
+    void setMaximumStep(double maxStep);
+
+    double getUniformity() const;
+    double getTolerance() const;
+    double getMinimumStep() const;
+    double getMaximumStep() const;
+    std::string getDescription() const;
+};
+
+} // namespace grpropa
+
+#endif // GRPROPA_PROPAGATIONHELIX_H
@@ -21,9 +21,12 @@ class Synchrotron: public Module {
 private:
     ref_ptr<MagneticField> Bfield;
     double CriticalB;
+    // continuous loss over the current step in the field b
+    void loseEnergy(Candidate *candidate, const Vector3d &b) const;
 public:
     Synchrotron(ref_ptr<MagneticField> field, double Bcr = 4.14e9);
     void process(Candidate *candidate) const;
+    void process(Candidate **candidates, size_t n) const;
 };
 
 
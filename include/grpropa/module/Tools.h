@@ -21,6 +21,7 @@ public:
     ~PerformanceModule();
     void add(Module* module);
     void process(Candidate* candidate) const;
+    void endRun();
     std::string getDescription() const;
 };
 
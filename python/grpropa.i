@@ -33,31 +33,39 @@ using std::ptrdiff_t;
 #include "grpropa/module/BreakCondition.h"
 #include "grpropa/module/Boundary.h"
 #include "grpropa/module/Observer.h"
+#include "grpropa/module/ObserverHistogram.h"
 #include "grpropa/module/OutputTXT.h"
 #include "grpropa/module/OutputShell.h"
 #include "grpropa/module/SimplePropagation.h"
 #include "grpropa/module/PropagationCK.h"
+#include "grpropa/module/PropagationHelix.h"
 #include "grpropa/module/Tools.h"
 
 #include "grpropa/magneticField/MagneticField.h"
 #include "grpropa/magneticField/MagneticFieldGrid.h"
 #include "grpropa/magneticField/AMRMagneticField.h"
+#include "grpropa/magneticField/CachedMagneticField.h"
 #include "grpropa/magneticField/JF12Field.h"
+#include "grpropa/magneticField/OctreeMagneticField.h"
 #include "grpropa/magneticField/TurbulentMagneticField.h"
 
 #include "grpropa/Referenced.h"
 #include "grpropa/Candidate.h"
 #include "grpropa/ParticleState.h"
 #include "grpropa/Module.h"
+#include "grpropa/OutputWriter.h"
 #include "grpropa/ModuleList.h"
 #include "grpropa/Random.h"
 #include "grpropa/Units.h"
 #include "grpropa/Vector3.h"
 #include "grpropa/Source.h"
 #include "grpropa/Common.h"
+#include "grpropa/LookupTable.h"
+#include "grpropa/TableFile.h"
 #include "grpropa/Cosmology.h"
 #include "grpropa/PhotonBackground.h"
 #include "grpropa/Grid.h"
+#include "grpropa/QuantizedGrid.h"
 #include "grpropa/GridTools.h"
 %}
 
@@ -92,6 +100,7 @@ using std::ptrdiff_t;
 %feature("ref")   grpropa::Referenced "$this->addReference();"
 %feature("unref") grpropa::Referenced "$this->removeReference();"
 
+%template(DoubleVector) std::vector<double>;
 
 %include "grpropa/Vector3.h"
 %template(Vector3d) grpropa::Vector3<double>;
@@ -100,6 +109,8 @@ using std::ptrdiff_t;
 %include "grpropa/Referenced.h"
 %include "grpropa/Units.h"
 %include "grpropa/Common.h"
+%include "grpropa/LookupTable.h"
+%include "grpropa/TableFile.h"
 %include "grpropa/Cosmology.h"
 %include "grpropa/PhotonBackground.h"
 %include "grpropa/Random.h"
@@ -114,11 +125,16 @@ using std::ptrdiff_t;
 %feature("director") grpropa::Module;
 %include "grpropa/Module.h"
 
+%implicitconv grpropa::ref_ptr<grpropa::OutputWriter>;
+%template(OutputWriterRefPtr) grpropa::ref_ptr<grpropa::OutputWriter>;
+%include "grpropa/OutputWriter.h"
+
 %implicitconv grpropa::ref_ptr<grpropa::MagneticField>;
 %template(MagneticFieldRefPtr) grpropa::ref_ptr<grpropa::MagneticField>;
 %include "grpropa/magneticField/MagneticField.h"
 
 %include "grpropa/Grid.h"
+%include "grpropa/QuantizedGrid.h"
 %include "grpropa/GridTools.h"
 
 %implicitconv grpropa::ref_ptr<grpropa::Grid<grpropa::Vector3<float> > >;
@@ -129,16 +145,33 @@ using std::ptrdiff_t;
 %template(ScalarGridRefPtr) grpropa::ref_ptr<grpropa::Grid<float> >;
 %template(ScalarGrid) grpropa::Grid<float>;
 
+%template(VectorGridCursor) grpropa::GridCursor<grpropa::Vector3<float> >;
+%template(ScalarGridCursor) grpropa::GridCursor<float>;
+
+%implicitconv grpropa::ref_ptr<grpropa::QuantizedVectorGrid<int16_t> >;
+%template(QuantizedVectorGrid16RefPtr) grpropa::ref_ptr<grpropa::QuantizedVectorGrid<int16_t> >;
+%template(QuantizedVectorGrid16) grpropa::QuantizedVectorGrid<int16_t>;
+%implicitconv grpropa::ref_ptr<grpropa::QuantizedVectorGrid<int8_t> >;
+%template(QuantizedVectorGrid8RefPtr) grpropa::ref_ptr<grpropa::QuantizedVectorGrid<int8_t> >;
+%template(QuantizedVectorGrid8) grpropa::QuantizedVectorGrid<int8_t>;
+
 %include "grpropa/magneticField/MagneticFieldGrid.h"
+%template(QuantizedMagneticFieldGrid16) grpropa::QuantizedMagneticFieldGrid<int16_t>;
+%template(QuantizedMagneticFieldGrid8) grpropa::QuantizedMagneticFieldGrid<int8_t>;
 %include "grpropa/magneticField/AMRMagneticField.h"
+%template(CachedMagneticFieldRefPtr) grpropa::ref_ptr<grpropa::CachedMagneticField>;
+%include "grpropa/magneticField/CachedMagneticField.h"
 %include "grpropa/magneticField/JF12Field.h"
+%include "grpropa/magneticField/OctreeMagneticField.h"
 %include "grpropa/magneticField/TurbulentMagneticField.h"
 
 %include "grpropa/module/BreakCondition.h"
 %include "grpropa/module/Boundary.h"
 %include "grpropa/module/Observer.h"
+%include "grpropa/module/ObserverHistogram.h"
 %include "grpropa/module/SimplePropagation.h"
 %include "grpropa/module/PropagationCK.h"
+%include "grpropa/module/PropagationHelix.h"
 %include "grpropa/module/OutputTXT.h"
 %include "grpropa/module/OutputShell.h"
 %include "grpropa/module/Synchrotron.h"
@@ -195,6 +228,8 @@ ObserverNeutrinoVeto.__repr__ = ObserverNeutrinoVeto.getDescription
 ObserverPhotonVeto.__repr__ = ObserverPhotonVeto.getDescription
 ObserverOutput1D.__repr__ = ObserverOutput1D.getDescription
 ObserverOutput3D.__repr__ = ObserverOutput3D.getDescription
+ObserverColumnOutput.__repr__ = ObserverColumnOutput.getDescription
+ObserverHistogram.__repr__ = ObserverHistogram.getDescription
 
 def Vector3__repr__(self):
     return "Vector(%.3g, %.3g, %.3g)" % (self.x, self.y, self.z)
@@ -0,0 +1,83 @@
+"""
+Reader for the binary column files of ObserverColumnOutput.
+
+The file is memory mapped and every column of every block is returned as a
+numpy array that points into the mapping, so nothing is read or copied
+before it is used. Compressed files (.gz) are decompressed into memory
+instead.
+
+    f = ColumnFile('events.bin')
+    f.names             # ['ID', 'E', ...]
+    for block in f.blocks:
+        block['E']      # view of one block
+    E = f['E']          # whole column, concatenated if there are several blocks
+"""
+import gzip
+import numpy as np
+
+MAGIC = b'GRPCOLS\0'
+VERSION = 1
+
+
+def _string(raw):
+    return raw.split(b'\0')[0].decode('ascii')
+
+
+def _padded(n):
+    return (n + 7) & ~7
+
+
+class ColumnFile(object):
+    def __init__(self, filename):
+        self.filename = filename
+        with open(filename, 'rb') as f:
+            compressed = f.read(2) == b'\x1f\x8b'
+        if compressed:
+            with gzip.open(filename, 'rb') as f:
+                self.data = np.frombuffer(f.read(), dtype=np.uint8)
+        else:
+            self.data = np.memmap(filename, dtype=np.uint8, mode='r')
+        if len(self.data) < 24 or self.data[:8].tobytes() != MAGIC:
+            raise IOError('%s: not a column file' % filename)
+        version, ncols, self.blockRows, headerSize = self.data[8:24].view('<u4')
+        if version != VERSION:
+            raise IOError('%s: unsupported version %d' % (filename, version))
+
+        self.names, self.types, self.units = [], [], []
+        for i in range(ncols):
+            desc = self.data[24 + 32 * i:56 + 32 * i].tobytes()
+            self.names.append(_string(desc[:16]))
+            self.types.append(np.dtype(_string(desc[16:24])))
+            self.units.append(_string(desc[24:32]))
+
+        # index the blocks, a truncated last block (e.g. of an aborted run) is ignored
+        self.blocks = []
+        offset = int(headerSize)
+        while offset + 8 <= len(self.data):
+            n = int(self.data[offset:offset + 4].view('<u4')[0])
+            size = 8 + sum(_padded(n * t.itemsize) for t in self.types)
+            if offset + size > len(self.data):
+                break
+            block = {}
+            p = offset + 8
+            for name, t in zip(self.names, self.types):
+                block[name] = self.data[p:p + n * t.itemsize].view(t)
+                p += _padded(n * t.itemsize)
+            self.blocks.append(block)
+            offset += size
+
+    def __len__(self):
+        return sum(len(b[self.names[0]]) for b in self.blocks)
+
+    def __getitem__(self, name):
+        """Whole column; a view without copy if the file has a single block."""
+        if name not in self.names:
+            raise KeyError(name)
+        if len(self.blocks) == 1:
+            return self.blocks[0][name]
+        if len(self.blocks) == 0:
+            return np.zeros(0, dtype=self.types[self.names.index(name)])
+        return np.concatenate([b[name] for b in self.blocks])
+
+    def unit(self, name):
+        return self.units[self.names.index(name)]
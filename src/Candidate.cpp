@@ -1,7 +1,121 @@
 #include "grpropa/Candidate.h"
 
+#include <pthread.h>
+#include <map>
+#include <new>
+#include <stdexcept>
+
 namespace grpropa {
 
+// Candidates are recycled through free lists of fixed size chunks. Each thread
+// allocates from and releases to its own list without locking. Chunks are
+// exchanged with a shared list in batches when a thread runs empty or keeps
+// too many of them, e.g. when secondaries are released by another thread.
+// The lists are kept in thread specific storage rather than by OpenMP thread
+// number, as threads outside of OpenMP teams (e.g. of a host application or
+// Python) would share the slot of thread 0. The chunks of a thread that ends
+// go to the shared list. Slabs are never freed: the pool keeps the memory of
+// the largest number of candidates alive at once, e.g. of the largest
+// cascade, and later cascades reuse it.
+namespace {
+
+const size_t POOL_BATCH = 1024; // chunks per slab and per exchange
+const size_t POOL_CHUNK = (sizeof(Candidate) + 15) & ~size_t(15);
+
+struct PoolChunk {
+    PoolChunk *next;
+};
+
+struct CandidatePool {
+    PoolChunk *head;
+    size_t size;
+
+    void push(PoolChunk *chunk) {
+        chunk->next = head;
+        head = chunk;
+        size++;
+    }
+
+    PoolChunk *pop() {
+        PoolChunk *chunk = head;
+        head = chunk->next;
+        size--;
+        return chunk;
+    }
+};
+
+CandidatePool sharedPool; // zero-initialized, guarded by omp critical(candidatePool)
+pthread_key_t poolKey;
+pthread_once_t poolKeyOnce = PTHREAD_ONCE_INIT;
+int poolKeyStatus;
+
+// hand the chunks of an ending thread to the other threads
+void releasePool(void *p) {
+    CandidatePool *pool = static_cast<CandidatePool*>(p);
+#pragma omp critical(candidatePool)
+    {
+        while (pool->size > 0)
+            sharedPool.push(pool->pop());
+    }
+    delete pool;
+}
+
+void createPoolKey() {
+    poolKeyStatus = pthread_key_create(&poolKey, &releasePool);
+}
+
+CandidatePool &localPool() {
+    pthread_once(&poolKeyOnce, &createPoolKey);
+    if (poolKeyStatus != 0)
+        throw std::bad_alloc();
+    CandidatePool *pool = static_cast<CandidatePool*>(pthread_getspecific(poolKey));
+    if (pool == NULL) {
+        pool = new CandidatePool();
+        pthread_setspecific(poolKey, pool);
+    }
+    return *pool;
+}
+
+void allocateSlab(CandidatePool &pool) {
+    char *slab = static_cast<char*>(::operator new(POOL_BATCH * POOL_CHUNK));
+    for (size_t i = 0; i < POOL_BATCH; i++)
+        pool.push(reinterpret_cast<PoolChunk*>(slab + i * POOL_CHUNK));
+}
+
+void refill(CandidatePool &pool) {
+#pragma omp critical(candidatePool)
+    {
+        while ((sharedPool.size > 0) && (pool.size < POOL_BATCH))
+            pool.push(sharedPool.pop());
+    }
+    if (pool.size == 0)
+        allocateSlab(pool);
+}
+
+// Interned property names and values, see Candidate::internProperty. They
+// are stored in chunks that never move and are never changed or reused, so
+// getPropertyName can read them without locking.
+const PropertyKey PROPERTY_CHUNK = 1024;
+const PropertyKey MAX_PROPERTY_CHUNKS = 4096;
+
+struct PropertyRegistry {
+    std::string *chunks[MAX_PROPERTY_CHUNKS];
+    std::map<std::string, PropertyKey> keys;
+    PropertyKey size;
+    PropertyRegistry() :
+            size(0) {
+        for (PropertyKey i = 0; i < MAX_PROPERTY_CHUNKS; i++)
+            chunks[i] = NULL;
+    }
+};
+
+PropertyRegistry &propertyRegistry() {
+    static PropertyRegistry registry;
+    return registry;
+}
+
+} // namespace
+
 Candidate::Candidate(int id, double E, Vector3d pos, Vector3d dir, double z) :
         trajectoryLength(0), currentStep(0), nextStep(0), active(true) {
     ParticleState state(id, E, pos, dir);
@@ -10,10 +124,12 @@ Candidate::Candidate(int id, double E, Vector3d pos, Vector3d dir, double z) :
     previous = state;
     current = state;
     setRedshift(z);
+    clearPropertySlots();
 }
 
 Candidate::Candidate(const ParticleState &state) :
         source(state), created(state), current(state), previous(state), redshift(0), trajectoryLength(0), currentStep(0), nextStep(0), active(true) {
+    clearPropertySlots();
 }
 
 bool Candidate::isActive() const {
@@ -62,18 +178,37 @@ void Candidate::limitNextStep(double step) {
 }
 
 void Candidate::setProperty(const std::string &name, const std::string &value) {
+    if (nPropertySlotsUsed() > 0) {
+        int i = findPropertySlot(findPropertyKey(name));
+        if (i >= 0)
+            propertySlots[i].name = -1;
+    }
     properties[name] = value;
 }
 
 bool Candidate::getProperty(const std::string &name, std::string &value) const {
     PropertyMap::const_iterator i = properties.find(name);
-    if (i == properties.end())
+    if (i != properties.end()) {
+        value = i->second;
+        return true;
+    }
+    if (nPropertySlotsUsed() == 0)
         return false;
-    value = i->second;
+    int j = findPropertySlot(findPropertyKey(name));
+    if (j < 0)
+        return false;
+    value = getPropertyName(propertySlots[j].value);
     return true;
 }
 
 bool Candidate::removeProperty(const std::string& name) {
+    if (nPropertySlotsUsed() > 0) {
+        int j = findPropertySlot(findPropertyKey(name));
+        if (j >= 0) {
+            propertySlots[j].name = -1;
+            return true;
+        }
+    }
     PropertyMap::iterator i = properties.find(name);
     if (i == properties.end())
         return false;
@@ -83,21 +218,146 @@ bool Candidate::removeProperty(const std::string& name) {
 
 bool Candidate::hasProperty(const std::string &name) const {
     PropertyMap::const_iterator i = properties.find(name);
-    if (i == properties.end())
+    if (i != properties.end())
+        return true;
+    if (nPropertySlotsUsed() == 0)
         return false;
-    return true;
+    return findPropertySlot(findPropertyKey(name)) >= 0;
+}
+
+void Candidate::setProperty(PropertyKey name, PropertyKey value) {
+    int i = findPropertySlot(name);
+    if (i < 0)
+        i = findPropertySlot(-1); // free slot
+    if (i < 0) {
+        // all slots taken, fall back to the property map
+        properties[getPropertyName(name)] = getPropertyName(value);
+        return;
+    }
+    if (!properties.empty())
+        properties.erase(getPropertyName(name));
+    propertySlots[i].name = name;
+    propertySlots[i].value = value;
+}
+
+bool Candidate::removeProperty(PropertyKey name) {
+    int i = findPropertySlot(name);
+    if (i >= 0) {
+        propertySlots[i].name = -1;
+        return true;
+    }
+    if (properties.empty())
+        return false;
+    return removeProperty(getPropertyName(name));
+}
+
+bool Candidate::hasProperty(PropertyKey name) const {
+    if (findPropertySlot(name) >= 0)
+        return true;
+    if (properties.empty())
+        return false;
+    return properties.find(getPropertyName(name)) != properties.end();
+}
+
+Candidate::PropertyMap Candidate::getProperties() const {
+    PropertyMap all = properties;
+    for (int i = 0; i < nPropertySlots; i++)
+        if (propertySlots[i].name >= 0)
+            all[getPropertyName(propertySlots[i].name)] = getPropertyName(propertySlots[i].value);
+    return all;
+}
+
+Referenced *Candidate::getRecord(const Referenced *owner) const {
+    for (size_t i = 0; i < records.size(); i++)
+        if (records[i].owner == owner)
+            return records[i].data;
+    return NULL;
+}
+
+void Candidate::setRecord(const Referenced *owner, Referenced *data) {
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].owner == owner) {
+            records[i].data = data;
+            return;
+        }
+    }
+    Record r;
+    r.owner = owner;
+    r.data = data;
+    records.push_back(r);
+}
+
+void Candidate::clearPropertySlots() {
+    for (int i = 0; i < nPropertySlots; i++)
+        propertySlots[i].name = -1;
+}
+
+int Candidate::findPropertySlot(PropertyKey name) const {
+    for (int i = 0; i < nPropertySlots; i++)
+        if (propertySlots[i].name == name)
+            return i;
+    return -1;
+}
+
+int Candidate::nPropertySlotsUsed() const {
+    int n = 0;
+    for (int i = 0; i < nPropertySlots; i++)
+        n += (propertySlots[i].name >= 0);
+    return n;
+}
+
+PropertyKey Candidate::internProperty(const std::string &name) {
+    PropertyKey key;
+#pragma omp critical(propertyRegistry)
+    {
+        PropertyRegistry &r = propertyRegistry();
+        std::map<std::string, PropertyKey>::const_iterator i = r.keys.find(name);
+        if (i != r.keys.end()) {
+            key = i->second;
+        } else if (r.size < PROPERTY_CHUNK * MAX_PROPERTY_CHUNKS) {
+            key = r.size;
+            std::string *&chunk = r.chunks[key / PROPERTY_CHUNK];
+            if (chunk == NULL)
+                chunk = new std::string[PROPERTY_CHUNK];
+            chunk[key % PROPERTY_CHUNK] = name;
+            r.keys[name] = key;
+            r.size++;
+        } else {
+            key = -1;
+        }
+    }
+    if (key < 0)
+        throw std::runtime_error("Candidate: too many interned property names and values");
+    return key;
+}
+
+const std::string &Candidate::getPropertyName(PropertyKey key) {
+    // interned names are never changed, no locking needed
+    return propertyRegistry().chunks[key / PROPERTY_CHUNK][key % PROPERTY_CHUNK];
+}
+
+PropertyKey Candidate::findPropertyKey(const std::string &name) {
+    PropertyKey key = -1;
+#pragma omp critical(propertyRegistry)
+    {
+        PropertyRegistry &r = propertyRegistry();
+        std::map<std::string, PropertyKey>::const_iterator i = r.keys.find(name);
+        if (i != r.keys.end())
+            key = i->second;
+    }
+    return key;
+}
+
+Candidate::Candidate(const Candidate &parent, int id, double energy) :
+        source(parent.source), created(parent.current), current(parent.current), previous(parent.previous), active(true), redshift(parent.redshift), trajectoryLength(parent.trajectoryLength), currentStep(0), nextStep(0) {
+    current.setId(id);
+    current.setEnergy(energy);
+    clearPropertySlots();
+    records = parent.records;
 }
 
 void Candidate::addSecondary(int id, double energy) {
-    ref_ptr<Candidate> secondary = new Candidate;
-    secondary->setRedshift(redshift);
-    secondary->setTrajectoryLength(trajectoryLength);
-    secondary->source = source;
-    secondary->previous = previous;
-    secondary->created = current;
-    secondary->current = current;
-    secondary->current.setId(id);
-    secondary->current.setEnergy(energy);
+    ref_ptr<Candidate> secondary = new Candidate(*this, id, energy);
     secondaries.push_back(secondary);
 }
 
@@ -113,4 +373,35 @@ std::string Candidate::getDescription() const {
     return ss.str();
 }
 
+void *Candidate::operator new(size_t size) {
+    if (size != sizeof(Candidate))
+        return ::operator new(size); // derived classes
+
+    CandidatePool &pool = localPool();
+    if (pool.size == 0)
+        refill(pool);
+    return pool.pop();
+}
+
+void Candidate::operator delete(void *ptr, size_t size) {
+    if (ptr == NULL)
+        return;
+    if (size != sizeof(Candidate)) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    CandidatePool &pool = localPool();
+    pool.push(static_cast<PoolChunk*>(ptr));
+
+    // hand surplus chunks to the threads that allocate them
+    if (pool.size > 2 * POOL_BATCH) {
+#pragma omp critical(candidatePool)
+        {
+            for (size_t i = 0; i < POOL_BATCH; i++)
+                sharedPool.push(pool.pop());
+        }
+    }
+}
+
 } // namespace grpropa
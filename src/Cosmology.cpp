@@ -1,6 +1,7 @@
 #include "grpropa/Cosmology.h"
 #include "grpropa/Units.h"
 #include "grpropa/Common.h"
+#include "grpropa/LookupTable.h"
 
 #include <vector>
 #include <math.h>
@@ -26,6 +27,8 @@ struct Cosmology {
     std::vector<double> Dl; // luminosity distance [m]
     std::vector<double> Dt; // light travel distance [m]
 
+    LookupAxis zAxis; // lookup of Z, log-uniform after z = 0
+
     void update() {
         double dH = c_light / H0; // Hubble distance
 
@@ -44,6 +47,7 @@ struct Cosmology {
             Dl[i] = (1 + Z[i]) * Dc[i];
             Dt[i] = Dt[i - 1] + dH * dz * (1 / ((1 + Z[i]) * E[i]) + 1 / ((1 + Z[i - 1]) * E[i - 1])) / 2;
         }
+        zAxis.setNodes(Z);
     }
 
     Cosmology() {
@@ -111,7 +115,7 @@ double redshift2ComovingDistance(double z) {
         throw std::runtime_error("Cosmology: z < 0");
     if (z > cosmology.zmax)
         throw std::runtime_error("Cosmology: z > zmax");
-    return interpolate(z, cosmology.Z, cosmology.Dc);
+    return interpolate(z, cosmology.zAxis, cosmology.Dc);
 }
 
 double luminosityDistance2Redshift(double d) {
@@ -127,7 +131,7 @@ double redshift2LuminosityDistance(double z) {
         throw std::runtime_error("Cosmology: z < 0");
     if (z > cosmology.zmax)
         throw std::runtime_error("Cosmology: z > zmax");
-    return interpolate(z, cosmology.Z, cosmology.Dl);
+    return interpolate(z, cosmology.zAxis, cosmology.Dl);
 }
 
 double lightTravelDistance2Redshift(double d) {
@@ -143,7 +147,7 @@ double redshift2LightTravelDistance(double z) {
         throw std::runtime_error("Cosmology: z < 0");
     if (z > cosmology.zmax)
         throw std::runtime_error("Cosmology: z > zmax");
-    return interpolate(z, cosmology.Z, cosmology.Dt);
+    return interpolate(z, cosmology.zAxis, cosmology.Dt);
 }
 
 double comoving2LightTravelDistance(double d) {
@@ -2,6 +2,11 @@
 #include "grpropa/Random.h"
 #include "grpropa/Units.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -267,114 +272,265 @@ void initTurbulence(ref_ptr<VectorGrid> grid, double Brms, double lMin, double l
 }
 #endif // GRPROPA_HAVE_FFTW3F
 
+/** RMS and maximum of |B_quantized - B| divided by the RMS of |B| at random positions */
+template<typename Q>
+static void quantizationErrors(const VectorGrid &grid, const QuantizedVectorGrid<Q> &quantized,
+        size_t nSamples, int seed, double &rms, double &max) {
+    Random random(seed);
+    Vector3d extent(grid.getNx(), grid.getNy(), grid.getNz());
+    extent *= grid.getSpacing();
+
+    double sumB2 = 0, sumDiff2 = 0, maxDiff = 0;
+    for (size_t i = 0; i < nSamples; i++) {
+        Vector3d pos = grid.getOrigin() + Vector3d(random.rand() * extent.x,
+                random.rand() * extent.y, random.rand() * extent.z);
+        Vector3d b = grid.interpolate(pos);
+        Vector3d diff = Vector3d(quantized.interpolate(pos)) - b;
+        sumB2 += b.getR2();
+        sumDiff2 += diff.getR2();
+        maxDiff = std::max(maxDiff, diff.getR());
+    }
+    double rmsB = sqrt(sumB2 / nSamples);
+    rms = (rmsB > 0) ? sqrt(sumDiff2 / nSamples) / rmsB : 0;
+    max = (rmsB > 0) ? maxDiff / rmsB : 0;
+}
+
+double quantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid16> quantized, size_t nSamples, int seed) {
+    double rms, max;
+    quantizationErrors(*grid, *quantized, nSamples, seed, rms, max);
+    return rms;
+}
+
+double quantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid8> quantized, size_t nSamples, int seed) {
+    double rms, max;
+    quantizationErrors(*grid, *quantized, nSamples, seed, rms, max);
+    return rms;
+}
+
+double maxQuantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid16> quantized, size_t nSamples, int seed) {
+    double rms, max;
+    quantizationErrors(*grid, *quantized, nSamples, seed, rms, max);
+    return max;
+}
+
+double maxQuantizationError(ref_ptr<VectorGrid> grid, ref_ptr<QuantizedVectorGrid8> quantized, size_t nSamples, int seed) {
+    double rms, max;
+    quantizationErrors(*grid, *quantized, nSamples, seed, rms, max);
+    return max;
+}
+
 double turbulentCorrelationLength(double lMin, double lMax, double alpha) {
     double r = lMin / lMax;
     double a = -alpha - 2;
     return lMax / 2 * (a - 1) / a * (1 - pow(r, a)) / (1 - pow(r, a - 1));
 }
 
-void loadGrid(ref_ptr<VectorGrid> grid, std::string filename, double c) {
-    std::ifstream fin(filename.c_str(), std::ios::binary);
+// the binary files are read and written as arrays of Vector3f
+typedef char checkVector3fSize[(sizeof(Vector3f) == 3 * sizeof(float)) ? 1 : -1];
+
+/** Number of bytes of a file, or throw if it cannot be opened */
+static size_t fileSize(std::ifstream &fin, const std::string &what, const std::string &filename) {
     if (!fin) {
         std::stringstream ss;
-        ss << "load VectorGrid: " << filename << " not found";
+        ss << what << ": " << filename << " not found";
         throw std::runtime_error(ss.str());
     }
-
-    // get length of file and compare to size of grid
     fin.seekg(0, fin.end);
-    size_t length = fin.tellg() / sizeof(float);
-    fin.seekg (0, fin.beg);
+    size_t length = fin.tellg();
+    fin.seekg(0, fin.beg);
+    return length;
+}
+
+/**
+ Read a binary grid file with one bulk read per x-slab of Ny * Nz values.
+ The grid switches to internal storage, the slab buffer is the only
+ transient memory in addition to the grid.
+ */
+template<typename T>
+static void loadBinary(Grid<T> *grid, const std::string &filename, double c,
+        const std::string &what) {
+    std::ifstream fin(filename.c_str(), std::ios::binary);
+    size_t length = fileSize(fin, what, filename);
 
     size_t nx = grid->getNx();
     size_t ny = grid->getNy();
     size_t nz = grid->getNz();
-
-    if (length != (3 * nx * ny * nz))
+    if (length != nx * ny * nz * sizeof(T))
         throw std::runtime_error("loadGrid: file and grid size do not match");
-
-    for (int ix = 0; ix < grid->getNx(); ix++) {
-        for (int iy = 0; iy < grid->getNy(); iy++) {
-            for (int iz = 0; iz < grid->getNz(); iz++) {
-                Vector3f &b = grid->get(ix, iy, iz);
-                fin.read((char*) &(b.x), sizeof(float));
-                fin.read((char*) &(b.y), sizeof(float));
-                fin.read((char*) &(b.z), sizeof(float));
-                b *= c;
-            }
-        }
+    if (grid->hasExternalValues())
+        grid->setGridSize(nx, ny, nz);
+
+    std::vector<T> slab(ny * nz);
+    for (size_t ix = 0; ix < nx; ix++) {
+        if (!fin.read((char*) &slab[0], slab.size() * sizeof(T)))
+            throw std::runtime_error("loadGrid: could not read " + filename);
+        for (size_t iy = 0; iy < ny; iy++)
+            for (size_t iz = 0; iz < nz; iz++)
+                grid->get(ix, iy, iz) = slab[iy * nz + iz] * c;
     }
-    fin.close();
 }
 
-void loadGrid(ref_ptr<ScalarGrid> grid, std::string filename, double c) {
-    std::ifstream fin(filename.c_str(), std::ios::binary);
-    if (!fin) {
+template<typename T>
+static void dumpBinary(const Grid<T> *grid, const std::string &filename, double c,
+        const std::string &what) {
+    std::ofstream fout(filename.c_str(), std::ios::binary);
+    if (!fout) {
         std::stringstream ss;
-        ss << "load ScalarGrid: " << filename << " not found";
+        ss << what << ": " << filename << " not found";
         throw std::runtime_error(ss.str());
     }
 
-    // get length of file and compare to size of grid
-    fin.seekg(0, fin.end);
-    size_t length = fin.tellg() / sizeof(float);
-    fin.seekg (0, fin.beg);
-
     size_t nx = grid->getNx();
     size_t ny = grid->getNy();
     size_t nz = grid->getNz();
+    std::vector<T> slab(ny * nz);
+    for (size_t ix = 0; ix < nx; ix++) {
+        for (size_t iy = 0; iy < ny; iy++)
+            for (size_t iz = 0; iz < nz; iz++)
+                slab[iy * nz + iz] = grid->get(ix, iy, iz) * c;
+        fout.write((const char*) &slab[0], slab.size() * sizeof(T));
+    }
+    if (!fout)
+        throw std::runtime_error("dumpGrid: could not write " + filename);
+}
 
-    if (length != (nx * ny * nz))
-        throw std::runtime_error("loadGrid: file and grid size do not match");
-
-    for (int ix = 0; ix < nx; ix++) {
-        for (int iy = 0; iy < ny; iy++) {
-            for (int iz = 0; iz < nz; iz++) {
-                float &b = grid->get(ix, iy, iz);
-                fin.read((char*) &b, sizeof(float));
-                b *= c;
-            }
+namespace {
+
+/**
+ Private, read-only mapping of a whole file. Pages are loaded on first access
+ and shared through the page cache; writes to the mapping are copy-on-write
+ and never reach the file.
+ */
+class MappedGridFile: public Referenced {
+    int fd;
+    void *data;
+    size_t length;
+public:
+    MappedGridFile(const std::string &filename, size_t expectedLength) :
+            fd(-1), data(MAP_FAILED), length(0) {
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("mapGrid: could not open file " + filename);
+        struct stat st;
+        if ((fstat(fd, &st) != 0) || (size_t(st.st_size) != expectedLength)) {
+            close(fd);
+            throw std::runtime_error("mapGrid: file and grid size do not match");
+        }
+        length = st.st_size;
+        data = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("mapGrid: could not map file " + filename);
         }
     }
-    fin.close();
-}
 
-void dumpGrid(ref_ptr<VectorGrid> grid, std::string filename, double c) {
-    std::ofstream fout(filename.c_str(), std::ios::binary);
-    if (!fout) {
-        std::stringstream ss;
-        ss << "dump VectorGrid: " << filename << " not found";
-        throw std::runtime_error(ss.str());
+    ~MappedGridFile() {
+        munmap(data, length);
+        close(fd);
     }
-    for (int ix = 0; ix < grid->getNx(); ix++) {
-        for (int iy = 0; iy < grid->getNy(); iy++) {
-            for (int iz = 0; iz < grid->getNz(); iz++) {
-                Vector3f b = grid->get(ix, iy, iz) * c;
-                fout.write((char*) &(b.x), sizeof(float));
-                fout.write((char*) &(b.y), sizeof(float));
-                fout.write((char*) &(b.z), sizeof(float));
-            }
-        }
+
+    void *getData() const {
+        return data;
     }
-    fout.close();
+};
+
+} // namespace
+
+template<typename T>
+static void mapBinary(Grid<T> *grid, const std::string &filename,
+        size_t nx, size_t ny, size_t nz) {
+    if (grid->getLayout() != LinearGridLayout)
+        throw std::runtime_error("mapGrid: binary grid files have the linear layout");
+    ref_ptr<MappedGridFile> file = new MappedGridFile(filename, nx * ny * nz * sizeof(T));
+    grid->setExternalValues(nx, ny, nz, (T *) file->getData(), file.get());
+}
+
+void loadGrid(ref_ptr<VectorGrid> grid, std::string filename, double c) {
+    loadBinary(grid.get(), filename, c, "load VectorGrid");
+}
+
+void loadGrid(ref_ptr<ScalarGrid> grid, std::string filename, double c) {
+    loadBinary(grid.get(), filename, c, "load ScalarGrid");
+}
+
+void mapGrid(ref_ptr<VectorGrid> grid, std::string filename) {
+    mapBinary(grid.get(), filename, grid->getNx(), grid->getNy(), grid->getNz());
+}
+
+void mapGrid(ref_ptr<ScalarGrid> grid, std::string filename) {
+    mapBinary(grid.get(), filename, grid->getNx(), grid->getNy(), grid->getNz());
+}
+
+ref_ptr<VectorGrid> mapVectorGrid(std::string filename, Vector3d origin,
+        size_t Nx, size_t Ny, size_t Nz, double spacing) {
+    ref_ptr<VectorGrid> grid = new VectorGrid(origin, 0, 0, 0, spacing);
+    mapBinary(grid.get(), filename, Nx, Ny, Nz);
+    return grid;
+}
+
+ref_ptr<ScalarGrid> mapScalarGrid(std::string filename, Vector3d origin,
+        size_t Nx, size_t Ny, size_t Nz, double spacing) {
+    ref_ptr<ScalarGrid> grid = new ScalarGrid(origin, 0, 0, 0, spacing);
+    mapBinary(grid.get(), filename, Nx, Ny, Nz);
+    return grid;
+}
+
+void dumpGrid(ref_ptr<VectorGrid> grid, std::string filename, double c) {
+    dumpBinary(grid.get(), filename, c, "dump VectorGrid");
 }
 
 void dumpGrid(ref_ptr<ScalarGrid> grid, std::string filename, double c) {
+    dumpBinary(grid.get(), filename, c, "dump ScalarGrid");
+}
+
+template<typename Q>
+static void dumpQuantized(QuantizedVectorGrid<Q> *grid, const std::string &filename) {
     std::ofstream fout(filename.c_str(), std::ios::binary);
-    if (!fout) {
-        std::stringstream ss;
-        ss << "dump ScalarGrid: " << filename << " not found";
-        throw std::runtime_error(ss.str());
-    }
-    for (int ix = 0; ix < grid->getNx(); ix++) {
-        for (int iy = 0; iy < grid->getNy(); iy++) {
-            for (int iz = 0; iz < grid->getNz(); iz++) {
-                float b = grid->get(ix, iy, iz) * c;
-                fout.write((char*) &b, sizeof(float));
-            }
-        }
-    }
-    fout.close();
+    if (!fout)
+        throw std::runtime_error("dumpGrid: could not open " + filename);
+    const std::vector<float> &scales = grid->getScales();
+    const std::vector<Q> &values = grid->getValues();
+    uint32_t header[4] = {uint32_t(grid->getNx()), uint32_t(grid->getNy()),
+            uint32_t(grid->getNz()), uint32_t(sizeof(Q))};
+    fout.write((const char*) header, sizeof(header));
+    fout.write((const char*) &scales[0], scales.size() * sizeof(float));
+    fout.write((const char*) &values[0], values.size() * sizeof(Q));
+    if (!fout)
+        throw std::runtime_error("dumpGrid: could not write " + filename);
+}
+
+template<typename Q>
+static void loadQuantized(QuantizedVectorGrid<Q> *grid, const std::string &filename) {
+    std::ifstream fin(filename.c_str(), std::ios::binary);
+    size_t length = fileSize(fin, "load QuantizedVectorGrid", filename);
+    std::vector<float> &scales = grid->getScales();
+    std::vector<Q> &values = grid->getValues();
+    uint32_t header[4] = {0, 0, 0, 0};
+    fin.read((char*) header, sizeof(header));
+    if ((header[0] != grid->getNx()) || (header[1] != grid->getNy())
+            || (header[2] != grid->getNz()) || (header[3] != sizeof(Q))
+            || (length != sizeof(header) + scales.size() * sizeof(float) + values.size() * sizeof(Q)))
+        throw std::runtime_error("loadGrid: file and grid size do not match");
+    fin.read((char*) &scales[0], scales.size() * sizeof(float));
+    fin.read((char*) &values[0], values.size() * sizeof(Q));
+    if (!fin)
+        throw std::runtime_error("loadGrid: could not read " + filename);
+}
+
+void dumpGrid(ref_ptr<QuantizedVectorGrid16> grid, std::string filename) {
+    dumpQuantized(grid.get(), filename);
+}
+
+void dumpGrid(ref_ptr<QuantizedVectorGrid8> grid, std::string filename) {
+    dumpQuantized(grid.get(), filename);
+}
+
+void loadGrid(ref_ptr<QuantizedVectorGrid16> grid, std::string filename) {
+    loadQuantized(grid.get(), filename);
+}
+
+void loadGrid(ref_ptr<QuantizedVectorGrid8> grid, std::string filename) {
+    loadQuantized(grid.get(), filename);
 }
 
 void loadGridFromTxt(ref_ptr<VectorGrid> grid, std::string filename, double c) {
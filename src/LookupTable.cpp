@@ -0,0 +1,115 @@
+#include "grpropa/LookupTable.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace grpropa {
+
+// allowed deviation of a node from the log-uniform grid, in units of the spacing
+const double logUniformTolerance = 0.01;
+
+LookupAxis::LookupAxis() :
+        logUniform(false), first(0), logFirst(0), invLogStep(0) {
+}
+
+LookupAxis::LookupAxis(const std::vector<double> &nodes) {
+    setNodes(nodes);
+}
+
+void LookupAxis::setNodes(const std::vector<double> &n) {
+    nodes = n;
+    logUniform = false;
+    first = 0;
+    logFirst = 0;
+    invLogStep = 0;
+
+    if ((nodes.size() > 0) && (nodes[0] == 0))
+        first = 1; // leading zero node
+    if (nodes.size() < first + 2)
+        return;
+    if (nodes[first] <= 0)
+        return;
+
+    size_t nSteps = nodes.size() - 1 - first;
+    logFirst = log(nodes[first]);
+    double logStep = (log(nodes.back()) - logFirst) / nSteps;
+    if (!(logStep > 0))
+        return;
+
+    for (size_t i = first + 1; i < nodes.size(); i++) {
+        if (nodes[i] <= nodes[i - 1])
+            return;
+        double deviation = (log(nodes[i]) - logFirst) / logStep - (i - first);
+        if (fabs(deviation) > logUniformTolerance)
+            return;
+    }
+
+    invLogStep = 1 / logStep;
+    logUniform = true;
+}
+
+const std::vector<double> &LookupAxis::getNodes() const {
+    return nodes;
+}
+
+bool LookupAxis::isLogUniform() const {
+    return logUniform;
+}
+
+size_t LookupAxis::upperBound(double x) const {
+    if (!logUniform)
+        return std::upper_bound(nodes.begin(), nodes.end(), x) - nodes.begin();
+
+    size_t n = nodes.size();
+    if (!(x < nodes[n - 1]))
+        return n;
+    if (x < nodes[0])
+        return 0;
+    if (x < nodes[first])
+        return first; // between the leading zero and the log-uniform part
+
+    // estimate from the log-uniform grid, then correct for rounded nodes
+    double p = (log(x) - logFirst) * invLogStep;
+    size_t i = first + std::min((size_t) std::max(p, 0.), n - 2 - first);
+    while ((i > first) && (x < nodes[i]))
+        i--;
+    while (x >= nodes[i + 1])
+        i++;
+    return i + 1;
+}
+
+double interpolate(double x, const LookupAxis &X, const std::vector<double> &Y) {
+    size_t it = X.upperBound(x);
+    if (it == 0)
+        return Y.front();
+    if (it == X.size())
+        return Y.back();
+
+    size_t i = it - 1;
+    return Y[i] + (x - X[i]) * (Y[i + 1] - Y[i]) / (X[i + 1] - X[i]);
+}
+
+double interpolate2d(double x, double y, const LookupAxis &X,
+        const LookupAxis &Y, const std::vector<double> &Z) {
+    if (x >= X.back() || x < X.front())
+        return 0;
+    if (y >= Y.back() || y <= Y.front())
+        return 0;
+
+    size_t i = X.upperBound(x) - 1;
+    size_t j = Y.upperBound(y) - 1;
+    size_t ny = Y.size();
+
+    double Q11 = Z[i * ny + j];
+    double Q12 = Z[i * ny + j + 1];
+    double Q21 = Z[(i + 1) * ny + j];
+    double Q22 = Z[(i + 1) * ny + j + 1];
+
+    double fx = (x - X[i]) / (X[i + 1] - X[i]);
+    double fy = (y - Y[j]) / (Y[j + 1] - Y[j]);
+    double R1 = Q11 + fx * (Q21 - Q11);
+    double R2 = Q12 + fx * (Q22 - Q12);
+    return R1 + fy * (R2 - R1);
+}
+
+} // namespace grpropa
@@ -17,4 +17,12 @@ void Module::setDescription(const std::string &d) {
     description = d;
 }
 
+void Module::process(Candidate **candidates, size_t n) const {
+    for (size_t i = 0; i < n; i++)
+        process(candidates[i]);
+}
+
+void Module::endRun() {
+}
+
 } // namespace grpropa
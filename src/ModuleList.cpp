@@ -1,5 +1,6 @@
 #include "grpropa/ModuleList.h"
 #include "grpropa/ProgressBar.h"
+#include "grpropa/Clock.h"
 
 #if _OPENMP
 #include <omp.h>
@@ -20,8 +21,52 @@ void g_cancel_signal_callback(int sig) {
     g_cancel_signal_flag = true;
 }
 
+// number of primaries that are drawn and sorted at once in the cost predicted scheduling
+const size_t costPredictedBatchSize = 100000;
+
+static double wallTime() {
+#if _OPENMP
+    return omp_get_wtime();
+#else
+    return Clock::getInstance().getSecond();
+#endif
+}
+
+static size_t threadNumber() {
+#if _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+#if _OPENMP
+static omp_sched_t ompSchedule(ModuleList::Scheduling scheduling) {
+    switch (scheduling) {
+    case ModuleList::DynamicScheduling:
+    case ModuleList::CostPredictedScheduling:
+        return omp_sched_dynamic;
+    case ModuleList::GuidedScheduling:
+        return omp_sched_guided;
+    default:
+        return omp_sched_static;
+    }
+}
+#endif
+
+// orders candidate indices by decreasing primary energy
+struct CostGreater {
+    const ModuleList::candidate_vector_t &candidates;
+    CostGreater(const ModuleList::candidate_vector_t &candidates) :
+            candidates(candidates) {
+    }
+    bool operator()(size_t i, size_t j) const {
+        return candidates[i]->current.getEnergy() > candidates[j]->current.getEnergy();
+    }
+};
+
 ModuleList::ModuleList() :
-        showProgress(false) {
+        showProgress(false), parallelCascades(false), releaseSecondaries(false), scheduling(StaticScheduling), chunkSize(1000), batchSize(0), runTime(0), runStart(0), recordLoad(false) {
 }
 
 ModuleList::~ModuleList() {
@@ -31,6 +76,95 @@ void ModuleList::setShowProgress(bool show) {
     showProgress = show;
 }
 
+void ModuleList::setParallelCascades(bool parallel) {
+    parallelCascades = parallel;
+}
+
+bool ModuleList::getParallelCascades() const {
+    return parallelCascades;
+}
+
+void ModuleList::setReleaseSecondaries(bool release) {
+    releaseSecondaries = release;
+}
+
+bool ModuleList::getReleaseSecondaries() const {
+    return releaseSecondaries;
+}
+
+void ModuleList::setScheduling(Scheduling s, size_t chunk) {
+    scheduling = s;
+    if (chunk > 0)
+        chunkSize = chunk;
+    else
+        chunkSize = (s == StaticScheduling) ? 1000 : 1;
+}
+
+ModuleList::Scheduling ModuleList::getScheduling() const {
+    return scheduling;
+}
+
+size_t ModuleList::getChunkSize() const {
+    return chunkSize;
+}
+
+void ModuleList::setBatchSize(size_t n) {
+    batchSize = n;
+}
+
+size_t ModuleList::getBatchSize() const {
+    return batchSize;
+}
+
+bool ModuleList::useBatches() const {
+    return (batchSize > 1) && !parallelCascades;
+}
+
+size_t ModuleList::loopChunkSize() const {
+    // the chunk size counts primaries, the batched loops count batches
+    if (useBatches())
+        return std::max(chunkSize / batchSize, size_t(1));
+    return chunkSize;
+}
+
+std::vector<double> ModuleList::getThreadBusyTimes() const {
+    std::vector<double> busy(threadLoad.size());
+    for (size_t i = 0; i < threadLoad.size(); i++)
+        busy[i] = threadLoad[i].busy;
+    return busy;
+}
+
+std::vector<double> ModuleList::getThreadIdleTimes() const {
+    std::vector<double> idle(threadLoad.size());
+    for (size_t i = 0; i < threadLoad.size(); i++)
+        idle[i] = std::max(0., runTime - threadLoad[i].busy);
+    return idle;
+}
+
+void ModuleList::startLoadRecording() {
+#if _OPENMP
+    threadLoad.resize(omp_get_max_threads());
+#else
+    threadLoad.resize(1);
+#endif
+    for (size_t i = 0; i < threadLoad.size(); i++)
+        threadLoad[i].busy = 0;
+    runTime = 0;
+    runStart = wallTime();
+    recordLoad = true;
+}
+
+void ModuleList::stopLoadRecording() {
+    runTime = wallTime() - runStart;
+    recordLoad = false;
+}
+
+void ModuleList::endRun() {
+    module_list_t::iterator m;
+    for (m = modules.begin(); m != modules.end(); m++)
+        (*m)->endRun();
+}
+
 void ModuleList::add(Module *module) {
     modules.push_back(module);
 }
@@ -44,25 +178,218 @@ void ModuleList::process(Candidate *candidate) {
     }
 }
 
-void ModuleList::run(Candidate *candidate, bool recursive) {
-    while (candidate->isActive() && !g_cancel_signal_flag)
+void ModuleList::process(Candidate **candidates, size_t n) {
+    module_list_t::iterator iEntry = modules.begin();
+    while (iEntry != modules.end()) {
+        ref_ptr<Module> &module = *iEntry;
+        iEntry++;
+        module->process(candidates, n);
+    }
+}
+
+void ModuleList::propagate(Candidate **candidates, size_t n) {
+    double start = recordLoad ? wallTime() : 0;
+
+    std::vector<Candidate *> active(candidates, candidates + n);
+    while (!g_cancel_signal_flag) {
+        // drop the candidates that have finished in the last step
+        size_t nActive = 0;
+        for (size_t i = 0; i < active.size(); i++)
+            if (active[i]->isActive())
+                active[nActive++] = active[i];
+        active.resize(nActive);
+        if (nActive == 0)
+            break;
+        process(&active[0], nActive);
+    }
+
+    if (recordLoad) {
+        size_t i = threadNumber();
+        if (i < threadLoad.size())
+            threadLoad[i].busy += wallTime() - start;
+    }
+}
+
+void ModuleList::propagate(Candidate *candidate, bool singleStep) {
+    double start = recordLoad ? wallTime() : 0;
+
+    while (candidate->isActive() && !g_cancel_signal_flag) {
         process(candidate);
+        if (singleStep)
+            break;
+    }
+
+    if (recordLoad) {
+        size_t i = threadNumber();
+        if (i < threadLoad.size())
+            threadLoad[i].busy += wallTime() - start;
+    }
+}
+
+void ModuleList::runPrimary(Candidate *candidate, bool recursive) {
+    // the tasks of the cascades are collected at the end of the loop
+    if (recursive && parallelCascades)
+        runCascade(candidate);
+    else
+        runCandidate(candidate, recursive);
+}
+
+void ModuleList::spawnSecondaries(Candidate *candidate, size_t &nDone) {
+    while (nDone < candidate->secondaries.size()) {
+        // the task holds its own reference, the parent may be released first
+        ref_ptr<Candidate> secondary = candidate->secondaries[nDone++];
+#pragma omp task firstprivate(secondary)
+        {
+            if (!g_cancel_signal_flag)
+                runCascade(secondary);
+        }
+    }
+
+    // the tasks keep the released secondaries alive until they are finished
+    if (releaseSecondaries) {
+        candidate->clearSecondaries();
+        nDone = 0;
+    }
+}
+
+void ModuleList::runSecondaries(Candidate *candidate) {
+    for (size_t i = 0; i < candidate->secondaries.size(); i++) {
+        if (g_cancel_signal_flag)
+            break;
+        runCandidate(candidate->secondaries[i], true);
+    }
+    candidate->clearSecondaries();
+}
+
+void ModuleList::runCascade(Candidate *candidate) {
+    // secondaries become tasks right after the step that created them
+    size_t nDone = 0;
+    while (candidate->isActive() && !g_cancel_signal_flag) {
+        propagate(candidate, true);
+        spawnSecondaries(candidate, nDone);
+    }
+    spawnSecondaries(candidate, nDone);
+}
+
+void ModuleList::run(Candidate *candidate, bool recursive) {
+    runCandidate(candidate, recursive);
+}
+
+void ModuleList::runCandidate(Candidate *candidate, bool recursive) {
+    if (recursive && parallelCascades) {
+        // wait for the whole cascade, including tasks spawned by secondaries
+#pragma omp taskgroup
+        runCascade(candidate);
+        return;
+    }
+
+    if (recursive && releaseSecondaries) {
+        // finish the secondaries of each step before taking the next one
+        runSecondaries(candidate);
+        while (candidate->isActive() && !g_cancel_signal_flag) {
+            propagate(candidate, true);
+            runSecondaries(candidate);
+        }
+        return;
+    }
+
+    propagate(candidate);
 
     // propagate secondaries
     if (recursive) {
         for (size_t i = 0; i < candidate->secondaries.size(); i++) {
             if (g_cancel_signal_flag)
                 break;
-            run(candidate->secondaries[i], recursive);
+            runCandidate(candidate->secondaries[i], recursive);
         }
     }
 }
 
+void ModuleList::runBatch(Candidate **candidates, size_t n, bool recursive) {
+    propagate(candidates, n);
+    if (!recursive)
+        return;
+
+    // the next generation, still owned by the candidates of this batch
+    std::vector<Candidate *> secondaries;
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < candidates[i]->secondaries.size(); j++)
+            secondaries.push_back(candidates[i]->secondaries[j]);
+
+    for (size_t offset = 0; offset < secondaries.size(); offset += batchSize) {
+        if (g_cancel_signal_flag)
+            break;
+        runBatch(&secondaries[offset], std::min(batchSize, secondaries.size() - offset), recursive);
+    }
+
+    if (releaseSecondaries)
+        for (size_t i = 0; i < n; i++)
+            candidates[i]->clearSecondaries();
+}
+
+void ModuleList::runBatches(candidate_vector_t &candidates, const std::vector<size_t> &order, bool recursive, ProgressBar &progressbar, bool release) {
+    size_t count = order.size();
+    size_t nBatches = (count + batchSize - 1) / batchSize;
+
+#pragma omp parallel for schedule(runtime)
+    for (size_t b = 0; b < nBatches; b++) {
+        if (g_cancel_signal_flag)
+            continue;
+
+        size_t offset = b * batchSize;
+        size_t n = std::min(batchSize, count - offset);
+        std::vector<Candidate *> batch(n);
+        for (size_t i = 0; i < n; i++)
+            batch[i] = candidates[order[offset + i]];
+        runBatch(&batch[0], n, recursive);
+        if (release)
+            for (size_t i = 0; i < n; i++)
+                candidates[order[offset + i]] = NULL;
+
+        if (showProgress)
+#pragma omp critical(progressbarUpdate)
+            for (size_t i = 0; i < n; i++)
+                progressbar.update();
+    }
+}
+
+void ModuleList::runSorted(candidate_vector_t &candidates, bool recursive, ProgressBar &progressbar, bool release) {
+    // deal out the most expensive primaries first
+    size_t count = candidates.size();
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), CostGreater(candidates));
+
+    if (useBatches()) {
+        runBatches(candidates, order, recursive, progressbar, release);
+        return;
+    }
+
+#pragma omp parallel for schedule(runtime)
+    for (size_t i = 0; i < count; i++) {
+        if (g_cancel_signal_flag)
+            continue;
+
+        runPrimary(candidates[order[i]], recursive);
+        if (release)
+            candidates[order[i]] = NULL; // with its secondaries
+
+        if (showProgress)
+#pragma omp critical(progressbarUpdate)
+            progressbar.update();
+    }
+}
+
 void ModuleList::run(candidate_vector_t &candidates, bool recursive) {
     size_t count = candidates.size();
 
 #if _OPENMP
     std::cout << "grpropa::ModuleList: Number of Threads: " << omp_get_max_threads() << std::endl;
+    omp_sched_t oldKind;
+    int oldChunk;
+    omp_get_schedule(&oldKind, &oldChunk);
+    omp_set_schedule(ompSchedule(scheduling), loopChunkSize());
 #endif
 
     ProgressBar progressbar(count);
@@ -75,25 +402,47 @@ void ModuleList::run(candidate_vector_t &candidates, bool recursive) {
     sighandler_t old_signal_handler = ::signal(SIGINT,
             g_cancel_signal_callback);
 
-#pragma omp parallel for schedule(static, 1000)
-    for (size_t i = 0; i < count; i++) {
-        if (g_cancel_signal_flag)
-            continue;
+    startLoadRecording();
+
+    if (scheduling == CostPredictedScheduling) {
+        runSorted(candidates, recursive, progressbar);
+    } else if (useBatches()) {
+        std::vector<size_t> order(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = i;
+        runBatches(candidates, order, recursive, progressbar);
+    } else {
+#pragma omp parallel for schedule(runtime)
+        for (size_t i = 0; i < count; i++) {
+            if (g_cancel_signal_flag)
+                continue;
 
-        run(candidates[i], recursive);
+            runPrimary(candidates[i], recursive);
 
-        if (showProgress)
+            if (showProgress)
 #pragma omp critical(progressbarUpdate)
-            progressbar.update();
+                progressbar.update();
+        }
     }
 
+    stopLoadRecording();
+    endRun();
+
     ::signal(SIGINT, old_signal_handler);
+
+#if _OPENMP
+    omp_set_schedule(oldKind, oldChunk);
+#endif
 }
 
 void ModuleList::run(Source *source, size_t count, bool recursive) {
 
 #if _OPENMP
     std::cout << "grpropa::ModuleList: Number of Threads: " << omp_get_max_threads() << std::endl;
+    omp_sched_t oldKind;
+    int oldChunk;
+    omp_get_schedule(&oldKind, &oldChunk);
+    omp_set_schedule(ompSchedule(scheduling), loopChunkSize());
 #endif
 
     ProgressBar progressbar(count);
@@ -106,20 +455,67 @@ void ModuleList::run(Source *source, size_t count, bool recursive) {
     sighandler_t old_signal_handler = ::signal(SIGINT,
             g_cancel_signal_callback);
 
-#pragma omp parallel for schedule(static, 1000)
-    for (size_t i = 0; i < count; i++) {
-        if (g_cancel_signal_flag)
-            continue;
+    startLoadRecording();
 
-        ref_ptr<Candidate> candidate = source->getCandidate();
-        run(candidate, recursive);
+    if (scheduling == CostPredictedScheduling) {
+        // the cost can only be estimated for primaries that have been drawn already
+        candidate_vector_t batch;
+        for (size_t offset = 0; offset < count; offset += costPredictedBatchSize) {
+            if (g_cancel_signal_flag)
+                break;
 
-        if (showProgress)
+            batch.resize(std::min(costPredictedBatchSize, count - offset));
+#pragma omp parallel for
+            for (size_t i = 0; i < batch.size(); i++)
+                batch[i] = source->getCandidate();
+
+            // only the primaries that are still running are kept in memory
+            runSorted(batch, recursive, progressbar, true);
+        }
+    } else if (useBatches()) {
+        size_t nBatches = (count + batchSize - 1) / batchSize;
+#pragma omp parallel for schedule(runtime)
+        for (size_t b = 0; b < nBatches; b++) {
+            if (g_cancel_signal_flag)
+                continue;
+
+            size_t n = std::min(batchSize, count - b * batchSize);
+            candidate_vector_t batch(n);
+            std::vector<Candidate *> lanes(n);
+            for (size_t i = 0; i < n; i++) {
+                batch[i] = source->getCandidate();
+                lanes[i] = batch[i];
+            }
+            runBatch(&lanes[0], n, recursive);
+
+            if (showProgress)
 #pragma omp critical(progressbarUpdate)
-            progressbar.update();
+                for (size_t i = 0; i < n; i++)
+                    progressbar.update();
+        }
+    } else {
+#pragma omp parallel for schedule(runtime)
+        for (size_t i = 0; i < count; i++) {
+            if (g_cancel_signal_flag)
+                continue;
+
+            ref_ptr<Candidate> candidate = source->getCandidate();
+            runPrimary(candidate, recursive);
+
+            if (showProgress)
+#pragma omp critical(progressbarUpdate)
+                progressbar.update();
+        }
     }
 
+    stopLoadRecording();
+    endRun();
+
     ::signal(SIGINT, old_signal_handler);
+
+#if _OPENMP
+    omp_set_schedule(oldKind, oldChunk);
+#endif
 }
 
 ModuleList::module_list_t &ModuleList::getModules() {
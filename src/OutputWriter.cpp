@@ -0,0 +1,301 @@
+#include "grpropa/OutputWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <stdexcept>
+
+#ifdef GRPROPA_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace grpropa {
+
+static double wallTime() {
+    timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+OutputWriter::OutputWriter(const std::string &filename, size_t blockSize,
+        double flushInterval, int compression) :
+        filename(filename), fd(-1),
+        blockSize(blockSize), flushInterval(flushInterval),
+        compression(compression), bytesWritten(0), closed(false), pending(0),
+        stopping(false) {
+    if (compression < 0) {
+        size_t n = filename.size();
+        bool gz = (n > 3) && (filename.compare(n - 3, 3, ".gz") == 0);
+        this->compression = gz ? 1 : 0;
+    }
+    if (this->compression > 9)
+        throw std::runtime_error("OutputWriter: compression has to be at most 9");
+#ifndef GRPROPA_HAVE_ZLIB
+    if (this->compression > 0)
+        throw std::runtime_error("OutputWriter: compiled without zlib, can not compress " + filename);
+#endif
+
+    fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("OutputWriter: could not open file " + filename);
+
+    for (size_t i = 0; i < buffers.size(); i++)
+        pthread_mutex_init(&buffers[i].lock, 0);
+    pthread_mutex_init(&mutex, 0);
+    pthread_cond_init(&wake, 0);
+    pthread_cond_init(&done, 0);
+    if (pthread_create(&thread, 0, &OutputWriter::run, this) != 0) {
+        ::close(fd);
+        throw std::runtime_error("OutputWriter: could not start the writer thread");
+    }
+}
+
+OutputWriter::~OutputWriter() {
+    try {
+        close();
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl; // destructors must not throw
+    }
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&mutex);
+    for (size_t i = 0; i < buffers.size(); i++)
+        pthread_mutex_destroy(&buffers[i].lock);
+}
+
+void OutputWriter::write(const char *data, size_t length) {
+    if (closed) {
+        // thrown by sync() and close(), not inside a parallel region
+        setError("OutputWriter: write to closed file " + filename);
+        return;
+    }
+    Buffer *b = buffers.local();
+    if (b == NULL)
+        b = &buffers.shared();
+
+    // uncontended unless the writer thread takes an aged buffer
+    pthread_mutex_lock(&b->lock);
+    if (b->data.empty()) {
+        b->since = wallTime();
+        if (b->data.capacity() < blockSize)
+            b->data.reserve(blockSize + 1024);
+    }
+    b->data.append(data, length);
+    bool full = (b->data.size() >= blockSize) || (wallTime() - b->since >= flushInterval);
+    pthread_mutex_unlock(&b->lock);
+    if (full)
+        handOver(*b);
+}
+
+void OutputWriter::write(const std::string &data) {
+    write(data.data(), data.size());
+}
+
+void OutputWriter::flush() {
+    Buffer *b = buffers.local();
+    handOver(b ? *b : buffers.shared());
+}
+
+void OutputWriter::handOver(Buffer &b, double maxAge) {
+    std::string block;
+    pthread_mutex_lock(&b.lock);
+    bool aged = !b.data.empty() && (wallTime() - b.since >= maxAge);
+    if (aged)
+        block.swap(b.data);
+    pthread_mutex_unlock(&b.lock);
+    if (!aged)
+        return;
+
+    // compress outside of any lock, so threads compress in parallel
+    std::string staging;
+    if (compression > 0) {
+        staging.swap(block);
+        if (!compress(staging, block)) {
+            setError("OutputWriter: could not compress a block of " + filename);
+            return;
+        }
+        staging.clear();
+    }
+
+    pthread_mutex_lock(&mutex);
+    bytesWritten += block.size();
+    queue.push_back(std::string());
+    queue.back().swap(block);
+    if (staging.capacity() == 0 && !spare.empty()) {
+        staging.swap(spare.back());
+        spare.pop_back();
+    }
+    pending++;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&mutex);
+
+    // give the buffer storage back, unless the owner has started a new one
+    pthread_mutex_lock(&b.lock);
+    if (b.data.capacity() == 0)
+        b.data.swap(staging);
+    pthread_mutex_unlock(&b.lock);
+}
+
+void OutputWriter::setError(const std::string &message) {
+    pthread_mutex_lock(&mutex);
+    if (error.empty())
+        error = message;
+    pthread_mutex_unlock(&mutex);
+}
+
+// compress data into a complete gzip member
+bool OutputWriter::compress(const std::string &data, std::string &block) const {
+#ifdef GRPROPA_HAVE_ZLIB
+    z_stream z;
+    z.zalloc = Z_NULL;
+    z.zfree = Z_NULL;
+    z.opaque = Z_NULL;
+    // window bits + 16 for a gzip header
+    if (deflateInit2(&z, compression, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    block.resize(deflateBound(&z, data.size()));
+    z.next_in = (Bytef *) data.data();
+    z.avail_in = data.size();
+    z.next_out = (Bytef *) &block[0];
+    z.avail_out = block.size();
+    int status = deflate(&z, Z_FINISH);
+    block.resize(block.size() - z.avail_out);
+    deflateEnd(&z);
+    return status == Z_STREAM_END;
+#else
+    return false;
+#endif
+}
+
+void OutputWriter::sync() {
+    if (!closed) {
+        for (size_t i = 0; i < buffers.size(); i++)
+            handOver(buffers[i]);
+
+        pthread_mutex_lock(&mutex);
+        while (pending > 0)
+            pthread_cond_wait(&done, &mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+    throwError();
+}
+
+void OutputWriter::close() {
+    if (closed) {
+        throwError();
+        return;
+    }
+    for (size_t i = 0; i < buffers.size(); i++)
+        handOver(buffers[i]);
+
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, 0);
+
+    ::close(fd);
+    closed = true;
+    for (size_t i = 0; i < buffers.size(); i++)
+        std::string().swap(buffers[i].data);
+    std::vector<std::string>().swap(spare);
+    throwError();
+}
+
+// report the first error once
+void OutputWriter::throwError() {
+    pthread_mutex_lock(&mutex);
+    std::string message;
+    message.swap(error);
+    pthread_mutex_unlock(&mutex);
+    if (!message.empty())
+        throw std::runtime_error(message);
+}
+
+const std::string &OutputWriter::getFilename() const {
+    return filename;
+}
+
+int OutputWriter::getCompression() const {
+    return compression;
+}
+
+size_t OutputWriter::getBytesWritten() const {
+    return bytesWritten;
+}
+
+void *OutputWriter::run(void *writer) {
+    static_cast<OutputWriter *>(writer)->writeBlocks();
+    return 0;
+}
+
+void OutputWriter::writeBlocks() {
+    std::deque<std::string> blocks;
+    double reclaimed = wallTime();
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        // take the buffers of threads that stopped writing, see handOver
+        if ((flushInterval > 0) && (wallTime() - reclaimed >= flushInterval)) {
+            pthread_mutex_unlock(&mutex);
+            for (size_t i = 0; i < buffers.size(); i++)
+                handOver(buffers[i], flushInterval);
+            reclaimed = wallTime();
+            pthread_mutex_lock(&mutex);
+        }
+        if (queue.empty() && !stopping) {
+            if (flushInterval > 0) {
+                double t = reclaimed + flushInterval;
+                timespec deadline;
+                deadline.tv_sec = time_t(t);
+                deadline.tv_nsec = long((t - floor(t)) * 1e9);
+                pthread_cond_timedwait(&wake, &mutex, &deadline);
+            } else {
+                pthread_cond_wait(&wake, &mutex);
+            }
+            continue;
+        }
+        if (queue.empty())
+            break;
+        blocks.swap(queue);
+        pthread_mutex_unlock(&mutex);
+
+        bool failed = false;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            const char *p = blocks[i].data();
+            size_t n = blocks[i].size();
+            while (n > 0) {
+                ssize_t k = ::write(fd, p, n);
+                if (k < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    failed = true;
+                    break;
+                }
+                p += k;
+                n -= k;
+            }
+        }
+
+        pthread_mutex_lock(&mutex);
+        if (failed && error.empty())
+            error = "OutputWriter: could not write file " + filename;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if ((compression > 0) || (spare.size() >= size_t(MAX_THREAD)))
+                break; // compressed blocks are not reused as buffers
+            blocks[i].clear();
+            spare.push_back(std::string());
+            spare.back().swap(blocks[i]);
+        }
+        pending -= blocks.size();
+        blocks.clear();
+        if (pending == 0)
+            pthread_cond_broadcast(&done);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+} // namespace grpropa
@@ -1,8 +1,15 @@
 #include "grpropa/PhotonBackground.h"
 #include "grpropa/Common.h"
+#include "grpropa/Units.h"
+#include "grpropa/TableFile.h"
 
 #include <vector>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
 
 namespace grpropa {
 
@@ -21,4 +28,354 @@ void listOfPhotonBackgroundModels()
     std::cout << "      Franceschini+ '08" << std::endl;
 }
 
+std::vector<double> photonFieldRedshifts(PhotonField photonField) {
+    static const double finke10[] = {0.00, 0.01, 0.02, 0.03, 0.04, 0.05, 0.07, 0.09, 0.10, 0.15, 0.20, 0.25, 0.30, 0.35, 0.40, 0.45, 0.50, 0.60, 0.70, 0.80, 0.90, 1.00, 1.20, 1.40, 1.60, 1.80, 2.00, 2.50, 3.00, 3.50, 4.00, 4.50, 4.99};
+    static const double gilmore12[] = {0, 0.015, 0.025, 0.044, 0.05, 0.2, 0.4, 0.5, 0.6, 0.8, 1.0, 1.25, 1.5, 2.0, 2.5, 3.0, 4.0, 5.0, 6.0, 7.0};
+    static const double dominguez11[] = {0, 0.01, 0.03, 0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.8, 1.0, 1.25, 1.5, 2.0, 2.5, 3.0, 3.9};
+    static const double kneiske10[] = {0.0, 0.1, 0.3, 0.8, 2.0};
+    static const double franceschini08[] = {0.0, 0.2, 0.4, 0.6, 0.8, 1.0, 1.2, 1.4, 1.6, 1.8, 2.0};
+
+    switch (photonField) {
+    case CMB:
+    case CRB:
+    case CRB_Protheroe96:
+    case CRB_ARCADE2:
+        return std::vector<double>();
+    case EBL:
+    case EBL_Gilmore12:
+        return std::vector<double>(gilmore12, gilmore12 + sizeof(gilmore12) / sizeof(double));
+    case EBL_Finke10:
+        return std::vector<double>(finke10, finke10 + sizeof(finke10) / sizeof(double));
+    case EBL_Dominguez11:
+    case EBL_Dominguez11_UL:
+    case EBL_Dominguez11_LL:
+        return std::vector<double>(dominguez11, dominguez11 + sizeof(dominguez11) / sizeof(double));
+    case EBL_Kneiske10:
+        return std::vector<double>(kneiske10, kneiske10 + sizeof(kneiske10) / sizeof(double));
+    case EBL_Franceschini08:
+        return std::vector<double>(franceschini08, franceschini08 + sizeof(franceschini08) / sizeof(double));
+    default:
+        throw std::runtime_error("photonFieldRedshifts: unknown photon background");
+    }
+}
+
+// Reads a whitespace separated table with nColumns columns, skipping comment lines.
+// Returns the columns one after another: column i of row j at [i * nRows + j].
+static std::vector<double> readColumns(const std::string &filename, size_t nColumns, size_t &nRows) {
+    std::ifstream infile(filename.c_str());
+    if (!infile.good())
+        throw std::runtime_error("PhotonBackground: could not open file " + filename);
+
+    std::vector<double> rows;
+    std::string line;
+    nRows = 0;
+    while (std::getline(infile, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        size_t n = 0;
+        double entry;
+        while (ss >> entry) {
+            rows.push_back(entry);
+            n++;
+        }
+        if (n == 0)
+            continue;
+        if (n != nColumns) {
+            std::stringstream msg;
+            msg << "PhotonBackground: expected " << nColumns << " columns in " << filename << ", found " << n;
+            throw std::runtime_error(msg.str());
+        }
+        nRows++;
+    }
+
+    std::vector<double> columns(rows.size());
+    for (size_t j = 0; j < nRows; j++)
+        for (size_t i = 0; i < nColumns; i++)
+            columns[i * nRows + j] = rows[j * nColumns + i];
+    return columns;
+}
+
+// Redshifts of the columns in the rate tables of a photon field
+static std::vector<double> rateTableRedshifts(PhotonField photonField) {
+    if (photonField != EBL_Finke10)
+        return photonFieldRedshifts(photonField);
+
+    // the Finke et al. 2010 rates are tabulated on a finer grid, z = 0, 0.01, ..., 4.99
+    std::vector<double> redshifts(500);
+    for (size_t i = 0; i < redshifts.size(); i++)
+        redshifts[i] = i * 0.01;
+    return redshifts;
+}
+
+// Contents of an interaction data file in SI units, see TableFileHeader
+struct RawTable {
+    std::vector<double> rows;
+    std::vector<double> redshifts;
+    std::vector<double> values;
+};
+
+// Reads a text table: one row per energy [eV] or cumulative probability, followed
+// by the rates [1/Mpc] or photon energies [eV] at each redshift of the photon field
+static void readTextTable(const std::string &filename, PhotonField photonField, TableKind kind, RawTable &table) {
+    double rowUnit = 1, valueUnit = eV;
+    if (kind == InteractionRateTableKind) {
+        table.redshifts = rateTableRedshifts(photonField);
+        rowUnit = eV;
+        valueUnit = 1 / Mpc;
+    } else {
+        table.redshifts = photonFieldRedshifts(photonField);
+    }
+    size_t nz = std::max(table.redshifts.size(), size_t(1));
+
+    size_t n;
+    std::vector<double> columns = readColumns(filename, nz + 1, n);
+    table.rows.resize(n);
+    table.values.resize(nz * n);
+    for (size_t j = 0; j < n; j++)
+        table.rows[j] = columns[j] * rowUnit;
+    for (size_t k = 0; k < nz * n; k++)
+        table.values[k] = columns[n + k] * valueUnit;
+}
+
+// Reads a binary table, the shape is taken from its header
+static void readBinaryTable(const TableFile &file, const std::string &filename, TableKind kind, RawTable &table) {
+    if (file.getKind() != kind)
+        throw std::runtime_error("PhotonBackground: wrong kind of table in " + filename);
+
+    size_t n = file.getRowCount();
+    size_t nz = file.getRedshiftCount();
+    size_t nValues = std::max(nz, size_t(1)) * n;
+    table.rows.assign(file.getRows(), file.getRows() + n);
+    table.redshifts.assign(file.getRedshifts(), file.getRedshifts() + nz);
+    table.values.assign(file.getValues(), file.getValues() + nValues);
+}
+
+std::string binaryTableFilename(const std::string &filename) {
+    std::string::size_type dot = filename.rfind('.');
+    std::string::size_type slash = filename.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return filename + ".bin";
+    return filename.substr(0, dot) + ".bin";
+}
+
+// Reads the binary version of a table if there is one and it is up to date,
+// otherwise the text file
+static void readTable(const std::string &filename, PhotonField photonField, TableKind kind, RawTable &table) {
+    std::string binary = binaryTableFilename(filename);
+    bool haveText = std::ifstream(filename.c_str()).good();
+    if (isTableFile(binary) && !haveText) {
+        TableFile file(binary);
+        readBinaryTable(file, binary, kind, table);
+    } else if (isTableFile(binary)) {
+        std::string problem;
+        try {
+            TableFile file(binary);
+            if (file.isUpToDate(filename)) {
+                readBinaryTable(file, binary, kind, table);
+                return;
+            }
+            problem = "not converted from the current " + filename;
+        } catch (std::exception &e) {
+            problem = e.what();
+        }
+        std::cerr << "PhotonBackground: ignoring " << binary << " (" << problem
+                << "), run grpropa-convert-tables to update it" << std::endl;
+        readTextTable(filename, photonField, kind, table);
+    } else if (isTableFile(filename)) {
+        TableFile file(filename);
+        readBinaryTable(file, filename, kind, table);
+    } else
+        readTextTable(filename, photonField, kind, table);
+}
+
+void convertInteractionTable(const std::string &textFile, const std::string &tableFile,
+        PhotonField photonField, TableKind kind) {
+    RawTable table;
+    readTextTable(textFile, photonField, kind, table);
+    writeTableFile(tableFile, kind, table.rows, table.redshifts, table.values, textFile);
+}
+
+static ref_ptr<const InteractionRateTable> loadInteractionRateTable(const std::string &filename, PhotonField photonField) {
+    RawTable raw;
+    readTable(filename, photonField, InteractionRateTableKind, raw);
+
+    ref_ptr<InteractionRateTable> table = new InteractionRateTable;
+    table->energies.swap(raw.rows);
+    table->redshifts.swap(raw.redshifts);
+    table->rates.swap(raw.values);
+    table->energyAxis.setNodes(table->energies);
+    table->redshiftAxis.setNodes(table->redshifts);
+    return table.get();
+}
+
+static ref_ptr<const PhotonEnergyTable> loadPhotonEnergyTable(const std::string &filename, PhotonField photonField) {
+    RawTable raw;
+    readTable(filename, photonField, PhotonEnergyTableKind, raw);
+
+    ref_ptr<PhotonEnergyTable> table = new PhotonEnergyTable;
+    table->redshifts = raw.redshifts;
+    table->sampler.setTable(raw.rows, raw.values, raw.redshifts);
+    table->localSampler.setTable(raw.rows, raw.values);
+    return table.get();
+}
+
+// Tables that have been loaded in this process, by photon field and file
+typedef std::pair<PhotonField, std::string> TableKey;
+
+ref_ptr<const InteractionRateTable> getInteractionRateTable(const std::string &filename, PhotonField photonField) {
+    static std::map<TableKey, ref_ptr<const InteractionRateTable> > tables;
+    ref_ptr<const InteractionRateTable> table;
+#pragma omp critical(photonBackgroundTables)
+    {
+        std::map<TableKey, ref_ptr<const InteractionRateTable> >::iterator i = tables.find(TableKey(photonField, filename));
+        if (i != tables.end())
+            table = i->second;
+    }
+    if (table.valid())
+        return table;
+
+    // concurrent first loads of the same table are harmless, the first one is kept
+    table = loadInteractionRateTable(filename, photonField);
+#pragma omp critical(photonBackgroundTables)
+    {
+        std::map<TableKey, ref_ptr<const InteractionRateTable> >::iterator i = tables.find(TableKey(photonField, filename));
+        if (i != tables.end())
+            table = i->second;
+        else
+            tables[TableKey(photonField, filename)] = table;
+    }
+    return table;
+}
+
+ref_ptr<const PhotonEnergyTable> getPhotonEnergyTable(const std::string &filename, PhotonField photonField) {
+    static std::map<TableKey, ref_ptr<const PhotonEnergyTable> > tables;
+    ref_ptr<const PhotonEnergyTable> table;
+#pragma omp critical(photonBackgroundTables)
+    {
+        std::map<TableKey, ref_ptr<const PhotonEnergyTable> >::iterator i = tables.find(TableKey(photonField, filename));
+        if (i != tables.end())
+            table = i->second;
+    }
+    if (table.valid())
+        return table;
+
+    // concurrent first loads of the same table are harmless, the first one is kept
+    table = loadPhotonEnergyTable(filename, photonField);
+#pragma omp critical(photonBackgroundTables)
+    {
+        std::map<TableKey, ref_ptr<const PhotonEnergyTable> >::iterator i = tables.find(TableKey(photonField, filename));
+        if (i != tables.end())
+            table = i->second;
+        else
+            tables[TableKey(photonField, filename)] = table;
+    }
+    return table;
+}
+
+// number of buckets of the guide table over the cumulative probability
+const size_t photonSamplerGuideSize = 4096;
+
+PhotonEnergySampler::PhotonEnergySampler() {
+}
+
+void PhotonEnergySampler::setTable(const std::vector<double> &p,
+        const std::vector<double> &e, const std::vector<double> &z) {
+    size_t nRows = z.empty() ? 1 : z.size();
+    if (p.size() < 2)
+        throw std::runtime_error("PhotonEnergySampler: table needs at least two probabilities");
+    if (e.size() < nRows * p.size())
+        throw std::runtime_error("PhotonEnergySampler: energy table does not match the tabulated probabilities and redshifts");
+
+    probabilities = p;
+    energies.assign(e.begin(), e.begin() + nRows * p.size());
+    redshiftAxis.setNodes(z);
+
+    guide.resize(photonSamplerGuideSize);
+    for (size_t k = 0; k < guide.size(); k++) {
+        double u = double(k) / guide.size();
+        guide[k] = std::upper_bound(probabilities.begin(), probabilities.end(), u) - probabilities.begin();
+    }
+}
+
+double PhotonEnergySampler::energyAt(const Range &r, size_t j) const {
+    size_t n = probabilities.size();
+    double e = energies[r.slice * n + j];
+    if (r.fraction > 0)
+        e += r.fraction * (energies[(r.slice + 1) * n + j] - e);
+    return e;
+}
+
+PhotonEnergySampler::Range PhotonEnergySampler::getRange(double z, double emin) const {
+    Range r;
+    r.empty = false;
+    size_t n = probabilities.size();
+
+    if (redshiftAxis.empty()) {
+        // single table scaled with (1+z), probabilities are clamped to the table
+        r.slice = 0;
+        r.fraction = 0;
+        r.scale = 1 + z;
+        r.uLow = 0;
+        r.uHigh = 1;
+    } else {
+        // as interpolate2d: no photons outside of the tabulated ranges
+        if (z >= redshiftAxis.back() || z < redshiftAxis.front()) {
+            r.empty = true;
+            return r;
+        }
+        r.slice = redshiftAxis.upperBound(z) - 1;
+        r.fraction = (z - redshiftAxis[r.slice]) / (redshiftAxis[r.slice + 1] - redshiftAxis[r.slice]);
+        r.scale = 1;
+        r.uLow = probabilities.front();
+        r.uHigh = probabilities.back();
+    }
+
+    double t = emin / r.scale;
+    if (t <= energyAt(r, 0))
+        return r;
+    if (t > energyAt(r, n - 1)) {
+        r.empty = true;
+        return r;
+    }
+
+    // first node with energy >= t, the energies increase with the probability
+    size_t lo = 1, hi = n - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (energyAt(r, mid) < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    double e0 = energyAt(r, lo - 1), e1 = energyAt(r, lo);
+    double u = probabilities[lo];
+    if (e1 > e0)
+        u = probabilities[lo - 1] + (t - e0) / (e1 - e0) * (probabilities[lo] - probabilities[lo - 1]);
+    r.uLow = std::max(r.uLow, u);
+    return r;
+}
+
+double PhotonEnergySampler::sample(const Range &r, double u) const {
+    if (r.empty)
+        return 0;
+    u = r.uLow + u * (r.uHigh - r.uLow);
+
+    // number of probabilities <= u, starting from the guide table
+    size_t n = probabilities.size();
+    size_t k = std::min(size_t(u * guide.size()), guide.size() - 1);
+    size_t i = guide[k];
+    while (i < n && probabilities[i] <= u)
+        i++;
+
+    if (i == 0)
+        return r.scale * energyAt(r, 0);
+    if (i == n)
+        return r.scale * energyAt(r, n - 1);
+    double e0 = energyAt(r, i - 1);
+    double e1 = energyAt(r, i);
+    double f = (u - probabilities[i - 1]) / (probabilities[i] - probabilities[i - 1]);
+    return r.scale * (e0 + f * (e1 - e0));
+}
+
 } // namespace grpropa
@@ -59,6 +59,9 @@
 // This version is the same one used in CRPropa.
 
 #include "grpropa/Random.h"
+#include "grpropa/ThreadSlots.h"
+
+#include <pthread.h>
 
 namespace grpropa {
 
@@ -395,8 +398,6 @@ std::istream& operator>>(std::istream& is, Random& mtrand) {
 #include <stdexcept>
 
 // see http://stackoverflow.com/questions/8051108/using-the-openmp-threadprivate-directive-on-static-instances-of-c-stl-types
-const static int MAX_THREAD = 256;
-
 struct RANDOM_TLS_ITEM {
     Random r;
     char padding[80*64 - sizeof(Random)];
@@ -429,5 +430,52 @@ void Random::seedThreads(const uint32 oneSeed) {
 }
 #endif
 
+namespace {
+
+pthread_key_t slotKey;
+pthread_once_t slotKeyOnce = PTHREAD_ONCE_INIT;
+int slotKeyStatus;
+pthread_mutex_t slotMutex = PTHREAD_MUTEX_INITIALIZER;
+int freeSlots[MAX_THREAD]; // released by ended threads, guarded by slotMutex
+int nFreeSlots;
+int nextSlot;
+
+// the key holds the slot + 1, or MAX_THREAD + 1 for threads without a slot
+void releaseSlot(void *p) {
+    int i = int(reinterpret_cast<size_t>(p)) - 1;
+    if (i >= MAX_THREAD)
+        return;
+    pthread_mutex_lock(&slotMutex);
+    freeSlots[nFreeSlots++] = i;
+    pthread_mutex_unlock(&slotMutex);
+}
+
+void createSlotKey() {
+    slotKeyStatus = pthread_key_create(&slotKey, &releaseSlot);
+}
+
+} // namespace
+
+int threadSlot() {
+    pthread_once(&slotKeyOnce, &createSlotKey);
+    if (slotKeyStatus != 0)
+        return -1;
+    size_t key = reinterpret_cast<size_t>(pthread_getspecific(slotKey));
+    if (key == 0) {
+        // first call of this thread, take the slot of an ended thread or a new one
+        pthread_mutex_lock(&slotMutex);
+        int i = MAX_THREAD;
+        if (nFreeSlots > 0)
+            i = freeSlots[--nFreeSlots];
+        else if (nextSlot < MAX_THREAD)
+            i = nextSlot++;
+        pthread_mutex_unlock(&slotMutex);
+        key = i + 1;
+        pthread_setspecific(slotKey, reinterpret_cast<void *>(key));
+    }
+    int i = int(key) - 1;
+    return (i < MAX_THREAD) ? i : -1;
+}
+
 } // namespace grpropa
 
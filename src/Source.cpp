@@ -284,14 +284,12 @@ void SourceUniform1D::setDescription() {
 // ----------------------------------------------------------------------------
 SourceDensityGrid::SourceDensityGrid(ref_ptr<ScalarGrid> grid) :
         grid(grid) {
+    // cumulative distribution in storage order, as drawn from in prepareParticle
+    std::vector<float> &values = grid->getGrid();
     float sum = 0;
-    for (int ix = 0; ix < grid->getNx(); ix++) {
-        for (int iy = 0; iy < grid->getNy(); iy++) {
-            for (int iz = 0; iz < grid->getNz(); iz++) {
-                sum += grid->get(ix, iy, iz);
-                grid->get(ix, iy, iz) = sum;
-            }
-        }
+    for (size_t i = 0; i < values.size(); i++) {
+        sum += values[i];
+        values[i] = sum;
     }
     setDescription();
 }
@@ -324,10 +322,12 @@ SourceDensityGrid1D::SourceDensityGrid1D(ref_ptr<ScalarGrid> grid) :
     if (grid->getNz() != 1)
         throw std::runtime_error("SourceDensityGrid1D: Nz != 1");
 
+    // cumulative distribution in storage order, as drawn from in prepareParticle
+    std::vector<float> &values = grid->getGrid();
     float sum = 0;
-    for (int ix = 0; ix < grid->getNx(); ix++) {
-        sum += grid->get(ix, 0, 0);
-        grid->get(ix, 0, 0) = sum;
+    for (size_t i = 0; i < values.size(); i++) {
+        sum += values[i];
+        values[i] = sum;
     }
     setDescription();
 }
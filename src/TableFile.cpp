@@ -0,0 +1,166 @@
+#include "grpropa/TableFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace grpropa {
+
+static const char tableFileMagic[8] = {'G', 'R', 'P', 'T', 'A', 'B', 'L', 'E'};
+static const uint32_t tableFileVersion = 2;
+static const uint32_t tableFileByteOrder = 0x01020304;
+
+// the arrays following the header have to stay aligned
+typedef char checkTableFileHeaderSize[(sizeof(TableFileHeader) == 128) ? 1 : -1];
+
+static void setName(char *field, size_t size, const char *name) {
+    memset(field, 0, size);
+    strncpy(field, name, size - 1);
+}
+
+TableFile::TableFile(const std::string &filename) :
+        fd(-1), data(MAP_FAILED), length(0), header(0) {
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("TableFile: could not open file " + filename);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(TableFileHeader)) {
+        close(fd);
+        throw std::runtime_error("TableFile: file too short " + filename);
+    }
+    length = st.st_size;
+
+    data = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("TableFile: could not map file " + filename);
+    }
+    header = (const TableFileHeader *) data;
+
+    std::string error;
+    if (memcmp(header->magic, tableFileMagic, sizeof(tableFileMagic)) != 0)
+        error = "not a table file";
+    else if (header->version != tableFileVersion)
+        error = "unsupported version";
+    else if (header->byteOrder != tableFileByteOrder)
+        error = "written with a different byte order";
+    else if (header->kind != InteractionRateTableKind && header->kind != PhotonEnergyTableKind)
+        error = "unknown table kind";
+    else if (header->nRows < 2)
+        error = "less than two rows";
+    else {
+        uint64_t nColumns = (header->nRedshifts > 0) ? header->nRedshifts : 1;
+        uint64_t nValues = header->nRows + header->nRedshifts + nColumns * header->nRows;
+        if (length != sizeof(TableFileHeader) + nValues * sizeof(double))
+            error = "size does not match the shape in the header";
+    }
+    if (!error.empty()) {
+        munmap(data, length);
+        close(fd);
+        throw std::runtime_error("TableFile: " + error + ", " + filename);
+    }
+}
+
+TableFile::~TableFile() {
+    munmap(data, length);
+    close(fd);
+}
+
+const TableFileHeader &TableFile::getHeader() const {
+    return *header;
+}
+
+TableKind TableFile::getKind() const {
+    return TableKind(header->kind);
+}
+
+size_t TableFile::getRowCount() const {
+    return header->nRows;
+}
+
+size_t TableFile::getRedshiftCount() const {
+    return header->nRedshifts;
+}
+
+const double *TableFile::getRows() const {
+    return (const double *) (header + 1);
+}
+
+const double *TableFile::getRedshifts() const {
+    return getRows() + header->nRows;
+}
+
+const double *TableFile::getValues() const {
+    return getRedshifts() + header->nRedshifts;
+}
+
+bool TableFile::isUpToDate(const std::string &sourceFile) const {
+    struct stat st;
+    if (stat(sourceFile.c_str(), &st) != 0)
+        return false;
+    return (header->sourceSize == uint64_t(st.st_size))
+            && (header->sourceTime == int64_t(st.st_mtime));
+}
+
+bool isTableFile(const std::string &filename) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    char magic[sizeof(tableFileMagic)];
+    if (!in.read(magic, sizeof(magic)))
+        return false;
+    return memcmp(magic, tableFileMagic, sizeof(magic)) == 0;
+}
+
+void writeTableFile(const std::string &filename, TableKind kind,
+        const std::vector<double> &rows, const std::vector<double> &redshifts,
+        const std::vector<double> &values, const std::string &sourceFile) {
+    size_t nColumns = redshifts.empty() ? 1 : redshifts.size();
+    if (values.size() != nColumns * rows.size())
+        throw std::runtime_error("writeTableFile: values do not match the rows and redshifts");
+
+    TableFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, tableFileMagic, sizeof(tableFileMagic));
+    header.version = tableFileVersion;
+    header.kind = kind;
+    header.nRows = rows.size();
+    header.nRedshifts = redshifts.size();
+    header.byteOrder = tableFileByteOrder;
+    struct stat st;
+    if (!sourceFile.empty()) {
+        if (stat(sourceFile.c_str(), &st) != 0)
+            throw std::runtime_error("writeTableFile: could not find source file " + sourceFile);
+        header.sourceSize = st.st_size;
+        header.sourceTime = st.st_mtime;
+    }
+    if (kind == InteractionRateTableKind) {
+        setName(header.rowAxis, sizeof(header.rowAxis), "energy");
+        setName(header.rowUnit, sizeof(header.rowUnit), "J");
+        setName(header.valueName, sizeof(header.valueName), "rate");
+        setName(header.valueUnit, sizeof(header.valueUnit), "1/m");
+    } else {
+        setName(header.rowAxis, sizeof(header.rowAxis), "probability");
+        setName(header.rowUnit, sizeof(header.rowUnit), "1");
+        setName(header.valueName, sizeof(header.valueName), "energy");
+        setName(header.valueUnit, sizeof(header.valueUnit), "J");
+    }
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.good())
+        throw std::runtime_error("writeTableFile: could not open file " + filename);
+    out.write((const char *) &header, sizeof(header));
+    out.write((const char *) &rows[0], rows.size() * sizeof(double));
+    if (!redshifts.empty())
+        out.write((const char *) &redshifts[0], redshifts.size() * sizeof(double));
+    out.write((const char *) &values[0], values.size() * sizeof(double));
+    if (!out.good())
+        throw std::runtime_error("writeTableFile: could not write file " + filename);
+}
+
+} // namespace grpropa
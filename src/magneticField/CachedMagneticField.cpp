@@ -0,0 +1,263 @@
+#include "grpropa/magneticField/CachedMagneticField.h"
+#include "grpropa/Random.h"
+
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <typeinfo>
+
+namespace grpropa {
+
+namespace {
+
+const int nProbes = 8;
+
+/**
+ Header of a cache file, followed by the samples as Vector3f in x-major order.
+ The probes are the sampled field at fixed positions in the box, so that a
+ file of the same field type with other parameters is not taken.
+ */
+struct CacheFileHeader {
+    char magic[8]; /**< "GRPFIELD" */
+    uint32_t version; /**< format version, currently 1 */
+    uint32_t byteOrder; /**< 0x01020304 in the byte order of the file */
+    uint64_t nx, ny, nz; /**< number of grid points */
+    double origin[3]; /**< lower corner of the box */
+    double extent[3]; /**< edge lengths of the box */
+    double spacing; /**< grid spacing */
+    char fieldType[64]; /**< type of the sampled field, possibly truncated */
+    double probes[nProbes][3]; /**< sampled field at the probe positions */
+};
+
+const char cacheMagic[8] = {'G', 'R', 'P', 'F', 'I', 'E', 'L', 'D'};
+
+// header of the cache file for a field and box, without the grid geometry
+void describe(const MagneticField &field, const Vector3d &origin,
+        const Vector3d &extent, CacheFileHeader &header) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = 1;
+    header.byteOrder = 0x01020304;
+    header.origin[0] = origin.x;
+    header.origin[1] = origin.y;
+    header.origin[2] = origin.z;
+    header.extent[0] = extent.x;
+    header.extent[1] = extent.y;
+    header.extent[2] = extent.z;
+    strncpy(header.fieldType, typeid(field).name(), sizeof(header.fieldType) - 1);
+    Random random(1234);
+    for (int i = 0; i < nProbes; i++) {
+        Vector3d p = origin + Vector3d(random.rand() * extent.x,
+                random.rand() * extent.y, random.rand() * extent.z);
+        Vector3d b = field.getField(p);
+        header.probes[i][0] = b.x;
+        header.probes[i][1] = b.y;
+        header.probes[i][2] = b.z;
+    }
+}
+
+bool sameProbe(double a, double b) {
+    if (isnan(a) || isnan(b))
+        return isnan(a) && isnan(b);
+    return fabs(a - b) <= 1e-6 * std::max(fabs(a), fabs(b));
+}
+
+// check that a cache file holds samples of the same field in the same box
+bool sameField(const CacheFileHeader &a, const CacheFileHeader &b) {
+    if ((a.version != b.version) || (a.byteOrder != b.byteOrder))
+        return false;
+    for (int i = 0; i < 3; i++)
+        if ((a.origin[i] != b.origin[i]) || (a.extent[i] != b.extent[i]))
+            return false;
+    if (strncmp(a.fieldType, b.fieldType, sizeof(a.fieldType)) != 0)
+        return false;
+    for (int i = 0; i < nProbes; i++)
+        for (int j = 0; j < 3; j++)
+            if (!sameProbe(a.probes[i][j], b.probes[i][j]))
+                return false;
+    return true;
+}
+
+/**
+ Read the header of a cache file, false if there is no such file.
+ Throws if the file is not a cache file, so that other files are not overwritten.
+ */
+bool readHeader(std::ifstream &fin, const std::string &filename, CacheFileHeader &header) {
+    if (!fin)
+        return false;
+    if (!fin.read((char *) &header, sizeof(header))
+            || (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0))
+        throw std::runtime_error("CachedMagneticField: " + filename + " is not a field cache file");
+    return true;
+}
+
+size_t gridPoints(const Vector3d &extent, double spacing) {
+    return size_t(ceil(extent.x / spacing) + 1) * size_t(ceil(extent.y / spacing) + 1)
+            * size_t(ceil(extent.z / spacing) + 1);
+}
+
+} // namespace
+
+CachedMagneticField::CachedMagneticField(ref_ptr<MagneticField> field,
+        const Vector3d &origin, const Vector3d &extent, double spacing,
+        const std::string &cacheFile) :
+        field(field), origin(origin), extent(extent) {
+    if (!(spacing > 0) || !(extent.x > 0) || !(extent.y > 0) || !(extent.z > 0))
+        throw std::runtime_error("CachedMagneticField: extent and spacing have to be positive");
+
+    // first grid point on the lower corner, the last ones on or beyond the upper faces
+    size_t nx = ceil(extent.x / spacing) + 1;
+    size_t ny = ceil(extent.y / spacing) + 1;
+    size_t nz = ceil(extent.z / spacing) + 1;
+    grid = new VectorGrid(origin - Vector3d(spacing / 2), nx, ny, nz, spacing);
+
+    if (!cacheFile.empty() && load(cacheFile))
+        return;
+
+#pragma omp parallel for schedule(dynamic)
+    for (int ix = 0; ix < int(nx); ix++) {
+        std::vector<double> xyz(3 * nz), b(3 * nz);
+        for (size_t iy = 0; iy < ny; iy++) {
+            for (size_t iz = 0; iz < nz; iz++) {
+                Vector3d p = origin + Vector3d(ix, iy, iz) * spacing;
+                xyz[3 * iz] = p.x;
+                xyz[3 * iz + 1] = p.y;
+                xyz[3 * iz + 2] = p.z;
+            }
+            field->getFields(&xyz[0], &b[0], nz);
+            for (size_t iz = 0; iz < nz; iz++) {
+                Vector3f v(b[3 * iz], b[3 * iz + 1], b[3 * iz + 2]);
+                // a singular sample would spoil all 8 cells around it
+                if (!(isfinite(v.x) && isfinite(v.y) && isfinite(v.z)))
+                    v = Vector3f(0.);
+                grid->get(ix, iy, iz) = v;
+            }
+        }
+    }
+
+    if (!cacheFile.empty())
+        save(cacheFile);
+}
+
+ref_ptr<CachedMagneticField> CachedMagneticField::fromTargetError(
+        ref_ptr<MagneticField> field, const Vector3d &origin,
+        const Vector3d &extent, double targetError, size_t maxPoints,
+        const std::string &cacheFile) {
+    double spacing = std::max(extent.x, std::max(extent.y, extent.z)) / 32;
+
+    // continue from the spacing of a cache file of this field and box
+    if (!cacheFile.empty()) {
+        std::ifstream fin(cacheFile.c_str(), std::ios::binary);
+        CacheFileHeader header, expected;
+        if (readHeader(fin, cacheFile, header)) {
+            describe(*field, origin, extent, expected);
+            if (sameField(header, expected)) {
+                ref_ptr<CachedMagneticField> cached = new CachedMagneticField(
+                        field, origin, extent, header.spacing, cacheFile);
+                if ((cached->getInterpolationError() <= targetError)
+                        || (gridPoints(extent, header.spacing / 2) > maxPoints))
+                    return cached;
+                spacing = header.spacing / 2;
+            }
+        }
+    }
+
+    ref_ptr<CachedMagneticField> cached = new CachedMagneticField(field, origin, extent, spacing);
+    while ((cached->getInterpolationError() > targetError)
+            && (gridPoints(extent, spacing / 2) <= maxPoints)) {
+        spacing /= 2;
+        cached = 0; // release the coarser grid first
+        cached = new CachedMagneticField(field, origin, extent, spacing);
+    }
+    if (!cacheFile.empty())
+        cached->save(cacheFile);
+    return cached;
+}
+
+ref_ptr<MagneticField> CachedMagneticField::getSampledField() {
+    return field;
+}
+
+ref_ptr<VectorGrid> CachedMagneticField::getGrid() {
+    return grid;
+}
+
+Vector3d CachedMagneticField::getOrigin() const {
+    return origin;
+}
+
+Vector3d CachedMagneticField::getExtent() const {
+    return extent;
+}
+
+double CachedMagneticField::getSpacing() const {
+    return grid->getSpacing();
+}
+
+bool CachedMagneticField::load(const std::string &filename) {
+    std::ifstream fin(filename.c_str(), std::ios::binary);
+    CacheFileHeader header, expected;
+    if (!readHeader(fin, filename, header))
+        return false;
+    describe(*field, origin, extent, expected);
+    if (!sameField(header, expected) || (header.spacing != grid->getSpacing())
+            || (header.nx != grid->getNx()) || (header.ny != grid->getNy())
+            || (header.nz != grid->getNz()))
+        return false; // samples of another field or geometry, sample again
+
+    std::vector<Vector3f> &values = grid->getGrid();
+    if (!fin.read((char *) &values[0], values.size() * sizeof(Vector3f)))
+        throw std::runtime_error("CachedMagneticField: could not read " + filename);
+    return true;
+}
+
+void CachedMagneticField::save(const std::string &filename) const {
+    CacheFileHeader header;
+    describe(*field, origin, extent, header);
+    header.nx = grid->getNx();
+    header.ny = grid->getNy();
+    header.nz = grid->getNz();
+    header.spacing = grid->getSpacing();
+
+    std::ofstream fout(filename.c_str(), std::ios::binary);
+    const std::vector<Vector3f> &values = grid->getGrid();
+    fout.write((const char *) &header, sizeof(header));
+    fout.write((const char *) &values[0], values.size() * sizeof(Vector3f));
+    if (!fout)
+        throw std::runtime_error("CachedMagneticField: could not write " + filename);
+}
+
+double CachedMagneticField::getInterpolationError(size_t nSamples, int seed) const {
+    Random random(seed);
+    double sumB2 = 0, sumDiff2 = 0;
+    for (size_t i = 0; i < nSamples; i++) {
+        Vector3d pos = origin + Vector3d(random.rand() * extent.x,
+                random.rand() * extent.y, random.rand() * extent.z);
+        Vector3d b = field->getField(pos);
+        if (!(isfinite(b.x) && isfinite(b.y) && isfinite(b.z)))
+            continue;
+        sumB2 += b.getR2();
+        sumDiff2 += (getField(pos) - b).getR2();
+    }
+    return (sumB2 > 0) ? sqrt(sumDiff2 / sumB2) : 0;
+}
+
+Vector3d CachedMagneticField::getField(const Vector3d &position) const {
+    Vector3d r = position - origin;
+    if ((r.x < 0) || (r.y < 0) || (r.z < 0) || (r.x > extent.x) || (r.y > extent.y) || (r.z > extent.z))
+        return field->getField(position);
+    return grid->interpolate(position);
+}
+
+void CachedMagneticField::getFields(const double *xyz, double *out, size_t n) const {
+    for (size_t i = 0; i < n; i++) {
+        Vector3d b = getField(Vector3d(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]));
+        out[3 * i] = b.x;
+        out[3 * i + 1] = b.y;
+        out[3 * i + 2] = b.z;
+    }
+}
+
+} // namespace grpropa
@@ -1,7 +1,22 @@
 #include "grpropa/magneticField/MagneticField.h"
 
+#include <algorithm>
+
 namespace grpropa {
 
+// number of positions the decorators handle at once in getFields
+const size_t fieldBatchSize = 64;
+
+void MagneticField::getFields(const double *xyz, double *out, size_t n) const {
+    for (size_t i = 0; i < n; i++) {
+        const double *p = xyz + 3 * i;
+        Vector3d b = getField(Vector3d(p[0], p[1], p[2]));
+        out[3 * i] = b.x;
+        out[3 * i + 1] = b.y;
+        out[3 * i + 2] = b.z;
+    }
+}
+
 PeriodicMagneticField::PeriodicMagneticField(ref_ptr<MagneticField> field, const Vector3d &extends) :
     field(field), extends(extends), origin(0, 0, 0), reflective(false) {
 
@@ -36,7 +51,7 @@ void PeriodicMagneticField::setReflective(bool reflective) {
     this->reflective = reflective;
 }
 
-Vector3d PeriodicMagneticField::getField(const Vector3d &position) const {
+Vector3d PeriodicMagneticField::mapPosition(const Vector3d &position) const {
     Vector3d n = ((position - origin) / extends).floor();
     Vector3d p = position - origin - n * extends;
 
@@ -52,7 +67,26 @@ Vector3d PeriodicMagneticField::getField(const Vector3d &position) const {
             p.z = extends.z - p.z;
     }
 
-    return field->getField(p);
+    return p;
+}
+
+Vector3d PeriodicMagneticField::getField(const Vector3d &position) const {
+    return field->getField(mapPosition(position));
+}
+
+void PeriodicMagneticField::getFields(const double *xyz, double *out, size_t n) const {
+    double mapped[3 * fieldBatchSize];
+    for (size_t offset = 0; offset < n; offset += fieldBatchSize) {
+        size_t m = std::min(fieldBatchSize, n - offset);
+        for (size_t i = 0; i < m; i++) {
+            const double *p = xyz + 3 * (offset + i);
+            Vector3d q = mapPosition(Vector3d(p[0], p[1], p[2]));
+            mapped[3 * i] = q.x;
+            mapped[3 * i + 1] = q.y;
+            mapped[3 * i + 2] = q.z;
+        }
+        field->getFields(mapped, out + 3 * offset, m);
+    }
 }
 
 void MagneticFieldList::addField(ref_ptr<MagneticField> field) {
@@ -66,4 +100,23 @@ Vector3d MagneticFieldList::getField(const Vector3d &position) const {
     return b;
 }
 
+void MagneticFieldList::getFields(const double *xyz, double *out, size_t n) const {
+    if (fields.empty()) {
+        std::fill(out, out + 3 * n, 0.);
+        return;
+    }
+
+    // the first field writes the result, the others are added in batches
+    fields[0]->getFields(xyz, out, n);
+    double b[3 * fieldBatchSize];
+    for (size_t offset = 0; offset < n; offset += fieldBatchSize) {
+        size_t m = std::min(fieldBatchSize, n - offset);
+        for (size_t j = 1; j < fields.size(); j++) {
+            fields[j]->getFields(xyz + 3 * offset, b, m);
+            for (size_t i = 0; i < 3 * m; i++)
+                out[3 * offset + i] += b[i];
+        }
+    }
+}
+
 } // namespace grpropa
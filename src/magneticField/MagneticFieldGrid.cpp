@@ -18,6 +18,23 @@ Vector3d MagneticFieldGrid::getField(const Vector3d &pos) const {
     return grid->interpolate(pos);
 }
 
+Vector3d MagneticFieldGrid::getField(const Vector3d &pos, VectorGridCursor &cursor) const {
+    if (cursor.getGrid() != grid.get())
+        cursor.setGrid(grid);
+    return cursor.interpolate(pos);
+}
+
+void MagneticFieldGrid::getFields(const double *xyz, double *out, size_t n) const {
+    const VectorGrid &g = *grid;
+    for (size_t i = 0; i < n; i++) {
+        const double *p = xyz + 3 * i;
+        Vector3f b = g.interpolate(Vector3d(p[0], p[1], p[2]));
+        out[3 * i] = b.x;
+        out[3 * i + 1] = b.y;
+        out[3 * i + 2] = b.z;
+    }
+}
+
 ModulatedMagneticFieldGrid::ModulatedMagneticFieldGrid(ref_ptr<VectorGrid> grid, ref_ptr<ScalarGrid> modGrid) {
     grid->setReflective(false);
     modGrid->setReflective(true);
@@ -52,4 +69,18 @@ Vector3d ModulatedMagneticFieldGrid::getField(const Vector3d &pos) const {
     return b * m;
 }
 
+void ModulatedMagneticFieldGrid::getFields(const double *xyz, double *out, size_t n) const {
+    const VectorGrid &g = *grid;
+    const ScalarGrid &mg = *modGrid;
+    for (size_t i = 0; i < n; i++) {
+        const double *p = xyz + 3 * i;
+        Vector3d pos(p[0], p[1], p[2]);
+        float m = mg.interpolate(pos);
+        Vector3d b = g.interpolate(pos);
+        out[3 * i] = b.x * m;
+        out[3 * i + 1] = b.y * m;
+        out[3 * i + 2] = b.z * m;
+    }
+}
+
 } // namespace grpropa
@@ -0,0 +1,126 @@
+#include "grpropa/magneticField/OctreeMagneticField.h"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <stdexcept>
+
+namespace grpropa {
+
+// positions are resolved to fixed point with this many bits per axis
+static const int octreeBits = 30;
+
+OctreeMagneticField::OctreeMagneticField(ref_ptr<MagneticField> field,
+        const Vector3d &origin, double size, int maxDepth, int minDepth,
+        double tolerance, double minStrength) :
+        origin(origin), size(size), maxDepth(maxDepth) {
+    if ((maxDepth < 0) || (maxDepth > octreeBits))
+        throw std::runtime_error("OctreeMagneticField: maxDepth has to be in [0, 30]");
+    if (!(size > 0))
+        throw std::runtime_error("OctreeMagneticField: size has to be positive");
+
+    Vector3d center = origin + Vector3d(size / 2);
+    Vector3d b = field->getField(center);
+    Node root;
+    root.child = -1;
+    root.field[0] = b.x;
+    root.field[1] = b.y;
+    root.field[2] = b.z;
+    nodes.push_back(root);
+    build(field, 0, center, 0, minDepth, tolerance, minStrength);
+}
+
+void OctreeMagneticField::build(ref_ptr<MagneticField> field, size_t node,
+        const Vector3d &center, int depth, int minDepth, double tolerance,
+        double minStrength) {
+    if (depth >= maxDepth)
+        return;
+
+    // field at the centers of the 8 children, child index = 4 * x + 2 * y + z
+    double h = ldexp(size, -depth - 2);
+    double xyz[24], b[24];
+    for (int i = 0; i < 8; i++) {
+        xyz[3 * i] = center.x + ((i & 4) ? h : -h);
+        xyz[3 * i + 1] = center.y + ((i & 2) ? h : -h);
+        xyz[3 * i + 2] = center.z + ((i & 1) ? h : -h);
+    }
+    field->getFields(xyz, b, 8);
+
+    if (depth >= minDepth) {
+        const float *p = nodes[node].field;
+        Vector3d parent(p[0], p[1], p[2]);
+        double limit = tolerance * std::max(parent.getR(), minStrength);
+        double deviation = 0;
+        for (int i = 0; i < 8; i++) {
+            // as stored, so that a tolerance of 0 does not refine on rounding
+            Vector3d d(float(b[3 * i]) - p[0], float(b[3 * i + 1]) - p[1], float(b[3 * i + 2]) - p[2]);
+            deviation = std::max(deviation, d.getR());
+        }
+        if (deviation <= limit)
+            return;
+    }
+
+    size_t first = nodes.size();
+    if (first + 8 > size_t(std::numeric_limits<int32_t>::max()))
+        throw std::runtime_error("OctreeMagneticField: too many nodes");
+    nodes[node].child = first;
+    for (int i = 0; i < 8; i++) {
+        Node c;
+        c.child = -1;
+        c.field[0] = b[3 * i];
+        c.field[1] = b[3 * i + 1];
+        c.field[2] = b[3 * i + 2];
+        nodes.push_back(c);
+    }
+    for (int i = 0; i < 8; i++)
+        build(field, first + i, Vector3d(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]),
+                depth + 1, minDepth, tolerance, minStrength);
+}
+
+size_t OctreeMagneticField::findLeaf(const Vector3d &position) const {
+    // fixed point position in the cube, the bits select the octants level by level
+    const double n = 1 << octreeBits;
+    Vector3d r = (position - origin) / size * n;
+    uint32_t ix = std::min(r.x, n - 1);
+    uint32_t iy = std::min(r.y, n - 1);
+    uint32_t iz = std::min(r.z, n - 1);
+    size_t i = 0;
+    for (int bit = octreeBits - 1; nodes[i].child >= 0; bit--)
+        i = nodes[i].child + ((((ix >> bit) & 1) << 2) | (((iy >> bit) & 1) << 1) | ((iz >> bit) & 1));
+    return i;
+}
+
+Vector3d OctreeMagneticField::getField(const Vector3d &position) const {
+    Vector3d r = position - origin;
+    if ((r.x < 0) || (r.y < 0) || (r.z < 0) || (r.x >= size) || (r.y >= size) || (r.z >= size))
+        return Vector3d(0.);
+    const float *b = nodes[findLeaf(position)].field;
+    return Vector3d(b[0], b[1], b[2]);
+}
+
+void OctreeMagneticField::getFields(const double *xyz, double *out, size_t n) const {
+    for (size_t i = 0; i < n; i++) {
+        Vector3d b = getField(Vector3d(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]));
+        out[3 * i] = b.x;
+        out[3 * i + 1] = b.y;
+        out[3 * i + 2] = b.z;
+    }
+}
+
+Vector3d OctreeMagneticField::getOrigin() const {
+    return origin;
+}
+
+double OctreeMagneticField::getSize() const {
+    return size;
+}
+
+int OctreeMagneticField::getMaxDepth() const {
+    return maxDepth;
+}
+
+size_t OctreeMagneticField::getNodeCount() const {
+    return nodes.size();
+}
+
+} // namespace grpropa
@@ -1,22 +1,259 @@
 #include "grpropa/magneticField/TurbulentMagneticField.h"
 #include "grpropa/Units.h"
 
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace grpropa {
 
+// Polynomial sincos after Cephes: reduction by pi/2 in three parts and
+// minimax polynomials on [-pi/4, pi/4], accurate to about 1e-16.
+static const double sinCoeff[6] = {1.58962301576546568060E-10,
+        -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+        -1.98412698295895385996E-4, 8.33333333332211858878E-3,
+        -1.66666666666666307295E-1};
+static const double cosCoeff[6] = {-1.13585365213876817300E-11,
+        2.08757008419747316778E-9, -2.75573141792967388112E-7,
+        2.48015872888517045348E-5, -1.38888888888730564116E-3,
+        4.16666666666665929218E-2};
+static const double pio2Part1 = 1.57079625129699707031E0;
+static const double pio2Part2 = 7.54978941586159635335E-8;
+static const double pio2Part3 = 5.39030285815811905290E-15;
+static const double twoOverPi = 6.36619772367581343076E-1;
+// adding this moves the integer value of a double into its low mantissa bits
+static const double integerMagic = 6755399441055744.0;
+// beyond this argument the reduction loses precision, the standard library is used
+static const double maxSinCosArgument = 1e8;
+
+static inline void sinCos(double x, double &s, double &c) {
+    if (fabs(x) > maxSinCosArgument) {
+        s = sin(x);
+        c = cos(x);
+        return;
+    }
+    double j = floor(x * twoOverPi + 0.5);
+    double r = ((x - j * pio2Part1) - j * pio2Part2) - j * pio2Part3;
+    double z = r * r;
+    double ps = (((((sinCoeff[0] * z + sinCoeff[1]) * z + sinCoeff[2]) * z
+            + sinCoeff[3]) * z + sinCoeff[4]) * z + sinCoeff[5]);
+    double pc = (((((cosCoeff[0] * z + cosCoeff[1]) * z + cosCoeff[2]) * z
+            + cosCoeff[3]) * z + cosCoeff[4]) * z + cosCoeff[5]);
+    double sr = r + r * z * ps;
+    double cr = 1 - 0.5 * z + z * z * pc;
+
+    // quadrant, also for negative j
+    int q = int(int64_t(j) & 3);
+    if (q & 1) {
+        double t = sr;
+        sr = cr;
+        cr = t;
+    }
+    s = (q & 2) ? -sr : sr;
+    c = ((q + 1) & 2) ? -cr : cr;
+}
+
+// Adds the modes [begin, end) at position p to b
+static void accumulateScalar(const double *m, size_t stride, size_t begin,
+        size_t end, const double *p, double *b) {
+    const double *kx = m, *ky = m + stride, *kz = m + 2 * stride;
+    const double *phase = m + 3 * stride;
+    const double *e1x = m + 4 * stride, *e1y = m + 5 * stride, *e1z = m + 6 * stride;
+    const double *e2x = m + 7 * stride, *e2y = m + 8 * stride, *e2z = m + 9 * stride;
+    for (size_t i = begin; i < end; i++) {
+        double s, c;
+        sinCos(kx[i] * p[0] + ky[i] * p[1] + kz[i] * p[2] + phase[i], s, c);
+        b[0] += c * e1x[i] - s * e2x[i];
+        b[1] += c * e1y[i] - s * e2y[i];
+        b[2] += c * e1z[i] - s * e2z[i];
+    }
+}
+
+#if defined(__AVX512F__)
+
+static void accumulateSIMD(const double *m, size_t stride, const double *p, double *b) {
+    const __m512d px = _mm512_set1_pd(p[0]), py = _mm512_set1_pd(p[1]), pz = _mm512_set1_pd(p[2]);
+    const __m512d limit = _mm512_set1_pd(maxSinCosArgument);
+    const __m512i one = _mm512_set1_epi64(1), two = _mm512_set1_epi64(2);
+    __m512d bx = _mm512_setzero_pd(), by = _mm512_setzero_pd(), bz = _mm512_setzero_pd();
+    double rest[3] = {0, 0, 0};
+
+    for (size_t i = 0; i < stride; i += 8) {
+        __m512d a = _mm512_fmadd_pd(_mm512_load_pd(m + i), px, _mm512_load_pd(m + 3 * stride + i));
+        a = _mm512_fmadd_pd(_mm512_load_pd(m + stride + i), py, a);
+        a = _mm512_fmadd_pd(_mm512_load_pd(m + 2 * stride + i), pz, a);
+        if (_mm512_cmp_pd_mask(_mm512_abs_pd(a), limit, _CMP_GT_OQ)) {
+            accumulateScalar(m, stride, i, i + 8, p, rest);
+            continue;
+        }
+
+        __m512d j = _mm512_roundscale_pd(_mm512_mul_pd(a, _mm512_set1_pd(twoOverPi)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m512d r = _mm512_fnmadd_pd(j, _mm512_set1_pd(pio2Part1), a);
+        r = _mm512_fnmadd_pd(j, _mm512_set1_pd(pio2Part2), r);
+        r = _mm512_fnmadd_pd(j, _mm512_set1_pd(pio2Part3), r);
+        __m512d z = _mm512_mul_pd(r, r);
+        __m512d ps = _mm512_set1_pd(sinCoeff[0]), pc = _mm512_set1_pd(cosCoeff[0]);
+        for (int k = 1; k < 6; k++) {
+            ps = _mm512_fmadd_pd(ps, z, _mm512_set1_pd(sinCoeff[k]));
+            pc = _mm512_fmadd_pd(pc, z, _mm512_set1_pd(cosCoeff[k]));
+        }
+        __m512d sr = _mm512_fmadd_pd(_mm512_mul_pd(r, z), ps, r);
+        __m512d cr = _mm512_fmadd_pd(_mm512_mul_pd(z, z), pc, _mm512_fnmadd_pd(_mm512_set1_pd(0.5), z, _mm512_set1_pd(1)));
+
+        __m512i q = _mm512_castpd_si512(_mm512_add_pd(j, _mm512_set1_pd(integerMagic)));
+        __mmask8 swap = _mm512_test_epi64_mask(q, one);
+        __m512d s = _mm512_mask_blend_pd(swap, sr, cr);
+        __m512d c = _mm512_mask_blend_pd(swap, cr, sr);
+        __m512i sinSign = _mm512_slli_epi64(_mm512_and_si512(q, two), 62);
+        __m512i cosSign = _mm512_slli_epi64(_mm512_and_si512(_mm512_add_epi64(q, one), two), 62);
+        s = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(s), sinSign));
+        c = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(c), cosSign));
+
+        bx = _mm512_fmadd_pd(c, _mm512_load_pd(m + 4 * stride + i), bx);
+        by = _mm512_fmadd_pd(c, _mm512_load_pd(m + 5 * stride + i), by);
+        bz = _mm512_fmadd_pd(c, _mm512_load_pd(m + 6 * stride + i), bz);
+        bx = _mm512_fnmadd_pd(s, _mm512_load_pd(m + 7 * stride + i), bx);
+        by = _mm512_fnmadd_pd(s, _mm512_load_pd(m + 8 * stride + i), by);
+        bz = _mm512_fnmadd_pd(s, _mm512_load_pd(m + 9 * stride + i), bz);
+    }
+
+    b[0] += _mm512_reduce_add_pd(bx) + rest[0];
+    b[1] += _mm512_reduce_add_pd(by) + rest[1];
+    b[2] += _mm512_reduce_add_pd(bz) + rest[2];
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+static inline double horizontalSum(__m256d v) {
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+}
+
+static void accumulateSIMD(const double *m, size_t stride, const double *p, double *b) {
+    const __m256d px = _mm256_set1_pd(p[0]), py = _mm256_set1_pd(p[1]), pz = _mm256_set1_pd(p[2]);
+    const __m256d limit = _mm256_set1_pd(maxSinCosArgument);
+    const __m256d signMask = _mm256_set1_pd(-0.);
+    const __m256i one = _mm256_set1_epi64x(1), two = _mm256_set1_epi64x(2);
+    __m256d bx = _mm256_setzero_pd(), by = _mm256_setzero_pd(), bz = _mm256_setzero_pd();
+    double rest[3] = {0, 0, 0};
+
+    for (size_t i = 0; i < stride; i += 4) {
+        __m256d a = _mm256_fmadd_pd(_mm256_load_pd(m + i), px, _mm256_load_pd(m + 3 * stride + i));
+        a = _mm256_fmadd_pd(_mm256_load_pd(m + stride + i), py, a);
+        a = _mm256_fmadd_pd(_mm256_load_pd(m + 2 * stride + i), pz, a);
+        if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(signMask, a), limit, _CMP_GT_OQ))) {
+            accumulateScalar(m, stride, i, i + 4, p, rest);
+            continue;
+        }
+
+        __m256d j = _mm256_round_pd(_mm256_mul_pd(a, _mm256_set1_pd(twoOverPi)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2Part1), a);
+        r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2Part2), r);
+        r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2Part3), r);
+        __m256d z = _mm256_mul_pd(r, r);
+        __m256d ps = _mm256_set1_pd(sinCoeff[0]), pc = _mm256_set1_pd(cosCoeff[0]);
+        for (int k = 1; k < 6; k++) {
+            ps = _mm256_fmadd_pd(ps, z, _mm256_set1_pd(sinCoeff[k]));
+            pc = _mm256_fmadd_pd(pc, z, _mm256_set1_pd(cosCoeff[k]));
+        }
+        __m256d sr = _mm256_fmadd_pd(_mm256_mul_pd(r, z), ps, r);
+        __m256d cr = _mm256_fmadd_pd(_mm256_mul_pd(z, z), pc, _mm256_fnmadd_pd(_mm256_set1_pd(0.5), z, _mm256_set1_pd(1)));
+
+        __m256i q = _mm256_castpd_si256(_mm256_add_pd(j, _mm256_set1_pd(integerMagic)));
+        __m256d swap = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(q, one), one));
+        __m256d s = _mm256_blendv_pd(sr, cr, swap);
+        __m256d c = _mm256_blendv_pd(cr, sr, swap);
+        __m256i sinSign = _mm256_slli_epi64(_mm256_and_si256(q, two), 62);
+        __m256i cosSign = _mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(q, one), two), 62);
+        s = _mm256_xor_pd(s, _mm256_castsi256_pd(sinSign));
+        c = _mm256_xor_pd(c, _mm256_castsi256_pd(cosSign));
+
+        bx = _mm256_fmadd_pd(c, _mm256_load_pd(m + 4 * stride + i), bx);
+        by = _mm256_fmadd_pd(c, _mm256_load_pd(m + 5 * stride + i), by);
+        bz = _mm256_fmadd_pd(c, _mm256_load_pd(m + 6 * stride + i), bz);
+        bx = _mm256_fnmadd_pd(s, _mm256_load_pd(m + 7 * stride + i), bx);
+        by = _mm256_fnmadd_pd(s, _mm256_load_pd(m + 8 * stride + i), by);
+        bz = _mm256_fnmadd_pd(s, _mm256_load_pd(m + 9 * stride + i), bz);
+    }
+
+    b[0] += horizontalSum(bx) + rest[0];
+    b[1] += horizontalSum(by) + rest[1];
+    b[2] += horizontalSum(bz) + rest[2];
+}
+
+#else
+
+static void accumulateSIMD(const double *m, size_t stride, const double *p, double *b) {
+    accumulateScalar(m, stride, 0, stride, p, b);
+}
+
+#endif
+
 TurbulentMagneticField::TurbulentMagneticField(double Brms, double lMin, double lMax, double spectralIndex, int nModes) {
     setTurbulenceProperties(Brms, lMin, lMax, spectralIndex, nModes);
     initialize();
 }
 
+TurbulentMagneticField::TurbulentMagneticField(const TurbulentMagneticField &field) :
+        MagneticField(field), nModes(field.nModes), spectralIndex(field.spectralIndex),
+        Brms(field.Brms), lMin(field.lMin), lMax(field.lMax), random(field.random) {
+    copyModes(field);
+}
+
+TurbulentMagneticField &TurbulentMagneticField::operator=(const TurbulentMagneticField &field) {
+    if (this == &field)
+        return *this;
+    MagneticField::operator=(field);
+    nModes = field.nModes;
+    spectralIndex = field.spectralIndex;
+    Brms = field.Brms;
+    lMin = field.lMin;
+    lMax = field.lMax;
+    random = field.random;
+    copyModes(field);
+    return *this;
+}
+
+// the alignment offset depends on the address of the buffer, so the arrays
+// are copied to the aligned start of the new buffer rather than the buffer
+void TurbulentMagneticField::copyModes(const TurbulentMagneticField &field) {
+    modeStride = field.modeStride;
+    modeBuffer.assign(field.modeBuffer.size(), 0.);
+    if (modeStride == 0)
+        return;
+    memcpy(const_cast<double *>(getModeArrays()), field.getModeArrays(),
+            N_MODE_ARRAYS * modeStride * sizeof(double));
+}
+
+const double *TurbulentMagneticField::getModeArrays() const {
+    // the buffer holds 8 extra doubles to align the arrays to 64 bytes
+    uintptr_t address = (uintptr_t) &modeBuffer[0];
+    return &modeBuffer[0] + ((64 - address % 64) % 64) / sizeof(double);
+}
+
+void TurbulentMagneticField::accumulate(const double *position, double *b) const {
+    if (modeStride == 0)
+        return;
+    accumulateSIMD(getModeArrays(), modeStride, position, b);
+}
+
 Vector3d TurbulentMagneticField::getField(const Vector3d &position) const {
-    Vector3d b(0.);
-    double a;
-    for (int i = 0; i < nModes; i++) {
-        Mode mode = modes[i];
-        a = mode.k.dot(position) + mode.phase;
-        b += mode.amplitude * (cos(a) * mode.e1 - sin(a) * mode.e2);
+    double p[3] = {position.x, position.y, position.z};
+    double b[3] = {0, 0, 0};
+    accumulate(p, b);
+    return Vector3d(b[0], b[1], b[2]);
+}
+
+void TurbulentMagneticField::getFields(const double *xyz, double *out, size_t n) const {
+    for (size_t i = 0; i < n; i++) {
+        double *b = out + 3 * i;
+        b[0] = b[1] = b[2] = 0;
+        accumulate(xyz + 3 * i, b);
     }
-    return b;
 }
 
 void TurbulentMagneticField::setTurbulenceProperties(double Brms, double lMin, double lMax, double spectralIndex, int nModes) {
@@ -36,7 +273,11 @@ void TurbulentMagneticField::initialize() {
     double dlk = (lkMax - lkMin) / (nModes - 1);
     double Lc = getCorrelationLength();
 
-    Mode mode;
+    modeStride = (nModes + 7) / 8 * 8;
+    modeBuffer.assign(N_MODE_ARRAYS * modeStride + 8, 0.);
+    double *m = const_cast<double *>(getModeArrays());
+    std::vector<double> amplitude(nModes);
+
     Vector3f ek, e1, e2; // orthogonal base
     Vector3f n0(1, 1, 1); // arbitrary vector to construct orthogonal base
 
@@ -54,26 +295,36 @@ void TurbulentMagneticField::initialize() {
             e2 = ek.cross(e1);
         }
         double k = pow(10, lkMin + i * dlk);
-        mode.k = ek * k;
+        Vector3d kv = ek * k;
+        m[KX * modeStride + i] = kv.x;
+        m[KY * modeStride + i] = kv.y;
+        m[KZ * modeStride + i] = kv.z;
 
         // amplitude (this seems to be wrong)
         double dk = k * dlk;
         double Gk = k * k * dk / (1 + pow(k * Lc, -spectralIndex));
         sumGk += Gk;
-        mode.amplitude = Brms * sqrt(Gk);
+        amplitude[i] = Brms * sqrt(Gk);
 
         // random orientation of b
         double alpha = random.rand(2 * M_PI);
-        mode.e1 = e1 / e1.getR() * cos(alpha);
-        mode.e2 = e2 / e2.getR() * sin(alpha);
+        Vector3d b1 = e1 / e1.getR() * cos(alpha);
+        Vector3d b2 = e2 / e2.getR() * sin(alpha);
+        m[E1X * modeStride + i] = b1.x;
+        m[E1Y * modeStride + i] = b1.y;
+        m[E1Z * modeStride + i] = b1.z;
+        m[E2X * modeStride + i] = b2.x;
+        m[E2Y * modeStride + i] = b2.y;
+        m[E2Z * modeStride + i] = b2.z;
 
         // random phase
-        mode.phase = random.rand(2 * M_PI);
-        modes.push_back(mode);
+        m[PHASE * modeStride + i] = random.rand(2 * M_PI);
     }
 
+    // include the normalized amplitudes in e1 and e2
     for (int i = 0; i < nModes; i++)
-        modes[i].amplitude /= sumGk;
+        for (int c = E1X; c <= E2Z; c++)
+            m[c * modeStride + i] *= amplitude[i] / sumGk;
 }
 
 void TurbulentMagneticField::initialize(int seed) {
@@ -112,11 +112,13 @@ std::string ReflectiveBox::getDescription() const {
 CubicBoundary::CubicBoundary() :
         origin(Vector3d(0, 0, 0)), size(0), margin(0), flag("OutOfBounds"), flagValue(
                 ""), limitStep(false) {
+    setFlag(flag, flagValue);
 }
 
 CubicBoundary::CubicBoundary(Vector3d o, double s) :
         origin(o), size(s), margin(0), flag("OutOfBounds"), flagValue(""), limitStep(
                 false) {
+    setFlag(flag, flagValue);
 }
 
 void CubicBoundary::process(Candidate *c) const {
@@ -125,7 +127,7 @@ void CubicBoundary::process(Candidate *c) const {
     double hi = r.max();
     if ((lo <= 0) or (hi >= size)) {
         c->setActive(false);
-        c->setProperty(flag, flagValue);
+        c->setProperty(flagKey, flagValueKey);
     }
     if (limitStep) {
         c->limitNextStep(lo + margin);
@@ -148,6 +150,8 @@ void CubicBoundary::setLimitStep(bool b) {
 void CubicBoundary::setFlag(std::string f, std::string v) {
     flag = f;
     flagValue = v;
+    flagKey = Candidate::internProperty(flag);
+    flagValueKey = Candidate::internProperty(flagValue);
 }
 
 std::string CubicBoundary::getDescription() const {
@@ -161,18 +165,20 @@ std::string CubicBoundary::getDescription() const {
 SphericalBoundary::SphericalBoundary() :
         center(Vector3d(0, 0, 0)), radius(0), flag("OutOfBounds"), flagValue(
                 ""), limitStep(false), margin(0) {
+    setFlag(flag, flagValue);
 }
 
 SphericalBoundary::SphericalBoundary(Vector3d c, double r) :
         center(c), radius(r), flag("OutOfBounds"), flagValue(""), limitStep(
                 false), margin(0) {
+    setFlag(flag, flagValue);
 }
 
 void SphericalBoundary::process(Candidate *c) const {
     double d = (c->current.getPosition() - center).getR();
     if (d >= radius) {
         c->setActive(false);
-        c->setProperty(flag, flagValue);
+        c->setProperty(flagKey, flagValueKey);
     }
     if (limitStep)
         c->limitNextStep(radius - d + margin);
@@ -193,6 +199,8 @@ void SphericalBoundary::setLimitStep(bool b) {
 void SphericalBoundary::setFlag(std::string f, std::string v) {
     flag = f;
     flagValue = v;
+    flagKey = Candidate::internProperty(flag);
+    flagValueKey = Candidate::internProperty(flagValue);
 }
 
 std::string SphericalBoundary::getDescription() const {
@@ -207,10 +215,12 @@ EllipsoidalBoundary::EllipsoidalBoundary() :
         focalPoint1(Vector3d(0, 0, 0)), focalPoint2(Vector3d(0, 0, 0)), majorAxis(
                 0), flag("OutOfBounds"), flagValue(""), limitStep(false), margin(
                 0) {
+    setFlag(flag, flagValue);
 }
 
 EllipsoidalBoundary::EllipsoidalBoundary(Vector3d f1, Vector3d f2, double a) :
         focalPoint1(f1), focalPoint2(f2), majorAxis(a), flag("OutOfBounds"), flagValue(""), limitStep(false), margin(0) {
+    setFlag(flag, flagValue);
 }
 
 void EllipsoidalBoundary::process(Candidate *c) const {
@@ -218,7 +228,7 @@ void EllipsoidalBoundary::process(Candidate *c) const {
     double d = pos.getDistanceTo(focalPoint1) + pos.getDistanceTo(focalPoint2);
     if (d >= majorAxis) {
         c->setActive(false);
-        c->setProperty(flag, flagValue);
+        c->setProperty(flagKey, flagValueKey);
     }
     if (limitStep)
         c->limitNextStep(majorAxis - d + margin);
@@ -240,6 +250,8 @@ void EllipsoidalBoundary::setLimitStep(bool b) {
 void EllipsoidalBoundary::setFlag(std::string f, std::string v) {
     flag = f;
     flagValue = v;
+    flagKey = Candidate::internProperty(flag);
+    flagValueKey = Candidate::internProperty(flagValue);
 }
 
 std::string EllipsoidalBoundary::getDescription() const {
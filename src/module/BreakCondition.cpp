@@ -7,10 +7,17 @@ namespace grpropa {
 
 MaximumTrajectoryLength::MaximumTrajectoryLength(double maxLength, std::string flag) :
         maxLength(maxLength), flag(flag) {
+    updateKeys();
+}
+
+void MaximumTrajectoryLength::updateKeys() {
+    flagKey = Candidate::internProperty(flag);
+    descriptionKey = Candidate::internProperty(getDescription());
 }
 
 void MaximumTrajectoryLength::setMaximumTrajectoryLength(double length) {
     maxLength = length;
+    updateKeys();
 }
 
 double MaximumTrajectoryLength::getMaximumTrajectoryLength() const {
@@ -19,6 +26,7 @@ double MaximumTrajectoryLength::getMaximumTrajectoryLength() const {
 
 void MaximumTrajectoryLength::setFlag(std::string f) {
     flag = f;
+    updateKeys();
 }
 
 std::string MaximumTrajectoryLength::getFlag() const {
@@ -36,7 +44,7 @@ void MaximumTrajectoryLength::process(Candidate *c) const {
     double l = c->getTrajectoryLength();
     if (l >= maxLength) {
         c->setActive(false);
-        c->setProperty(flag, getDescription());
+        c->setProperty(flagKey, descriptionKey);
     } else {
         c->limitNextStep(maxLength - l);
     }
@@ -44,10 +52,17 @@ void MaximumTrajectoryLength::process(Candidate *c) const {
 
 MinimumEnergy::MinimumEnergy(double minEnergy, std::string flag) :
         minEnergy(minEnergy), flag(flag) {
+    updateKeys();
+}
+
+void MinimumEnergy::updateKeys() {
+    flagKey = Candidate::internProperty(flag);
+    descriptionKey = Candidate::internProperty(getDescription());
 }
 
 void MinimumEnergy::setMinimumEnergy(double energy) {
     minEnergy = energy;
+    updateKeys();
 }
 
 double MinimumEnergy::getMinimumEnergy() const {
@@ -56,6 +71,7 @@ double MinimumEnergy::getMinimumEnergy() const {
 
 void MinimumEnergy::setFlag(std::string f) {
     flag = f;
+    updateKeys();
 }
 
 std::string MinimumEnergy::getFlag() const {
@@ -66,7 +82,7 @@ void MinimumEnergy::process(Candidate *c) const {
     if (c->current.getEnergy() > minEnergy)
         return;
     c->setActive(false);
-    c->setProperty(flag, getDescription());
+    c->setProperty(flagKey, descriptionKey);
 }
 
 std::string MinimumEnergy::getDescription() const {
@@ -77,10 +93,17 @@ std::string MinimumEnergy::getDescription() const {
 
 MinimumRedshift::MinimumRedshift(double zmin, std::string flag) :
         zmin(zmin), flag(flag) {
+    updateKeys();
+}
+
+void MinimumRedshift::updateKeys() {
+    flagKey = Candidate::internProperty(flag);
+    descriptionKey = Candidate::internProperty(getDescription());
 }
 
 void MinimumRedshift::setMinimumRedshift(double z) {
     zmin = z;
+    updateKeys();
 }
 
 double MinimumRedshift::getMinimumRedshift() {
@@ -89,6 +112,7 @@ double MinimumRedshift::getMinimumRedshift() {
 
 void MinimumRedshift::setFlag(std::string f) {
     flag = f;
+    updateKeys();
 }
 
 std::string MinimumRedshift::getFlag() const {
@@ -99,7 +123,7 @@ void MinimumRedshift::process(Candidate* c) const {
     if (c->getRedshift() > zmin)
         return;
     c->setActive(false);
-    c->setProperty(flag, getDescription());
+    c->setProperty(flagKey, descriptionKey);
 }
 
 std::string MinimumRedshift::getDescription() const {
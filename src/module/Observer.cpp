@@ -2,6 +2,12 @@
 #include "grpropa/Units.h"
 #include "grpropa/Cosmology.h"
 
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
 namespace grpropa {
 
 DetectionState ObserverFeature::checkDetection(Candidate *candidate) const {
@@ -11,18 +17,26 @@ DetectionState ObserverFeature::checkDetection(Candidate *candidate) const {
 void ObserverFeature::onDetection(Candidate *candidate) const {
 }
 
+void ObserverFeature::endRun() {
+}
+
 std::string ObserverFeature::getDescription() const {
     return description;
 }
 
 Observer::Observer(bool makeInactive) :
-        makeInactive(makeInactive) {
+        makeInactive(makeInactive), flagKey(-1), flagValueKey(-1) {
 }
 
 void Observer::add(ObserverFeature *feature) {
     features.push_back(feature);
 }
 
+void Observer::setFlag(std::string flag, std::string flagValue) {
+    flagKey = Candidate::internProperty(flag);
+    flagValueKey = Candidate::internProperty(flagValue);
+}
+
 void Observer::process(Candidate *candidate) const {
     // loop over all features and have them check the particle
     DetectionState state = NOTHING;
@@ -39,11 +53,19 @@ void Observer::process(Candidate *candidate) const {
             features[i]->onDetection(candidate);
         }
 
+        if (flagKey >= 0)
+            candidate->setProperty(flagKey, flagValueKey);
+
         if (makeInactive)
             candidate->setActive(false);
     }
 }
 
+void Observer::endRun() {
+    for (size_t i = 0; i < features.size(); i++)
+        features[i]->endRun();
+}
+
 std::string Observer::getDescription() const {
     std::stringstream ss;
     ss << "Observer\n";
@@ -189,23 +211,18 @@ std::string ObserverPhotonVeto::getDescription() const {
 
 ObserverOutput3D::ObserverOutput3D(std::string fname) {
     description = "ObserverOutput3D: " + fname;
-    fout.open(fname.c_str());
-    fout
-            << "# dT\tD\tID\tID0\tE\tE0\tX\tY\tZ\tX0\tY0\tZ0\tPx\tPy\tPz\tP0x\tP0y\tP0z\tz\n";
-    fout << "#\n";
-    fout << "# D           Trajectory length [Mpc]\n";
-    fout << "# ID          Particle type (PDG MC numbering scheme)\n";
-    fout << "# E           Energy [EeV]\n";
-    fout << "# X, Y, Z     Position [Mpc]\n";
-    fout << "# Px, Py, Pz  Heading (unit vector of momentum)\n";
-    fout << "# Initial state: ID0, E0, ...\n";
-    fout << "# z           Redshift\n";
-    fout << "#\n";
-    
-}
-
-ObserverOutput3D::~ObserverOutput3D() {
-    fout.close();
+    out = new OutputWriter(fname);
+    out->write("# dT\tD\tID\tID0\tE\tE0\tX\tY\tZ\tX0\tY0\tZ0\tPx\tPy\tPz\tP0x\tP0y\tP0z\tz\n");
+    out->write("#\n");
+    out->write("# D           Trajectory length [Mpc]\n");
+    out->write("# ID          Particle type (PDG MC numbering scheme)\n");
+    out->write("# E           Energy [EeV]\n");
+    out->write("# X, Y, Z     Position [Mpc]\n");
+    out->write("# Px, Py, Pz  Heading (unit vector of momentum)\n");
+    out->write("# Initial state: ID0, E0, ...\n");
+    out->write("# z           Redshift\n");
+    out->write("#\n");
+    out->flush();
 }
 
 void ObserverOutput3D::onDetection(Candidate *candidate) const {
@@ -231,27 +248,28 @@ void ObserverOutput3D::onDetection(Candidate *candidate) const {
     p += sprintf(buffer + p, "%8.7e\n", candidate->getRedshift());
 
 
-#pragma omp critical
-    {
-        fout.write(buffer, p);
-        fout.flush();
-    }
+    out->write(buffer, p);
 }
 
-ObserverOutput1D::ObserverOutput1D(std::string fname) {
-    description = "ObserverOutput1D: " + fname;
-    fout.open(fname.c_str());
-    fout << "#ID\tE\tD\tID0\tE0\n";
-    fout << "#\n";
-    fout << "# ID  Particle type\n";
-    fout << "# E   Energy [EeV]\n";
-    fout << "# D   Comoving trajectory length [Mpc]\n";
-    fout << "# ID0 Initial particle type\n";
-    fout << "# E0  Initial energy [eV]\n";
+void ObserverOutput3D::endRun() {
+    out->sync();
+}
+
+void ObserverOutput3D::close() {
+    out->close();
 }
 
-ObserverOutput1D::~ObserverOutput1D() {
-    fout.close();
+ObserverOutput1D::ObserverOutput1D(std::string fname) {
+    description = "ObserverOutput1D: " + fname;
+    out = new OutputWriter(fname);
+    out->write("#ID\tE\tD\tID0\tE0\n");
+    out->write("#\n");
+    out->write("# ID  Particle type\n");
+    out->write("# E   Energy [EeV]\n");
+    out->write("# D   Comoving trajectory length [Mpc]\n");
+    out->write("# ID0 Initial particle type\n");
+    out->write("# E0  Initial energy [eV]\n");
+    out->flush();
 }
 
 void ObserverOutput1D::onDetection(Candidate *candidate) const {
@@ -264,11 +282,204 @@ void ObserverOutput1D::onDetection(Candidate *candidate) const {
     p += sprintf(buffer + p, "%10i\t", candidate->source.getId());
     p += sprintf(buffer + p, "%.4e\n", candidate->source.getEnergy() / eV);
 
-#pragma omp critical
-    {
-        fout.write(buffer, p);
-        fout.flush();
+    out->write(buffer, p);
+}
+
+void ObserverOutput1D::endRun() {
+    out->sync();
+}
+
+void ObserverOutput1D::close() {
+    out->close();
+}
+
+// values are stored in 8 byte aligned columns
+static size_t padded(size_t n) {
+    return (n + 7) & ~size_t(7);
+}
+
+ObserverColumnOutput::ObserverColumnOutput(std::string fname, int select,
+        bool singlePrecision, size_t blockRows) :
+        blockRows(blockRows), closed(false) {
+    uint16_t one = 1;
+    if (*reinterpret_cast<char *>(&one) != 1)
+        throw std::runtime_error("ObserverColumnOutput: only little-endian machines are supported");
+    if (blockRows == 0)
+        throw std::runtime_error("ObserverColumnOutput: blockRows has to be positive");
+    description = "ObserverColumnOutput: " + fname;
+
+    if (select & TrajectoryLengthColumn)
+        addColumn("D", "Mpc", 0, false, singlePrecision);
+    if (select & IdColumn)
+        addColumn("ID", "", 1, true, singlePrecision);
+    if (select & SourceIdColumn)
+        addColumn("ID0", "", 2, true, singlePrecision);
+    if (select & EnergyColumn)
+        addColumn("E", "EeV", 3, false, singlePrecision);
+    if (select & SourceEnergyColumn)
+        addColumn("E0", "EeV", 4, false, singlePrecision);
+    if (select & PositionColumns) {
+        addColumn("X", "Mpc", 5, false, singlePrecision);
+        addColumn("Y", "Mpc", 6, false, singlePrecision);
+        addColumn("Z", "Mpc", 7, false, singlePrecision);
+    }
+    if (select & SourcePositionColumns) {
+        addColumn("X0", "Mpc", 8, false, singlePrecision);
+        addColumn("Y0", "Mpc", 9, false, singlePrecision);
+        addColumn("Z0", "Mpc", 10, false, singlePrecision);
+    }
+    if (select & DirectionColumns) {
+        addColumn("Px", "", 11, false, singlePrecision);
+        addColumn("Py", "", 12, false, singlePrecision);
+        addColumn("Pz", "", 13, false, singlePrecision);
+    }
+    if (select & SourceDirectionColumns) {
+        addColumn("P0x", "", 14, false, singlePrecision);
+        addColumn("P0y", "", 15, false, singlePrecision);
+        addColumn("P0z", "", 16, false, singlePrecision);
+    }
+    if (select & RedshiftColumn)
+        addColumn("z", "", 17, false, singlePrecision);
+    if (columns.empty())
+        throw std::runtime_error("ObserverColumnOutput: no columns selected");
+
+    blockSize = 8;
+    for (size_t i = 0; i < columns.size(); i++) {
+        columns[i].offset = blockSize;
+        blockSize += padded(blockRows * columns[i].size);
+    }
+
+    // header
+    std::string header(24 + 32 * columns.size(), '\0');
+    uint32_t fields[4] = {1, uint32_t(columns.size()), uint32_t(blockRows),
+            uint32_t(header.size())};
+    memcpy(&header[0], "GRPCOLS", 8);
+    memcpy(&header[8], fields, sizeof(fields));
+    for (size_t i = 0; i < columns.size(); i++) {
+        char *p = &header[24 + 32 * i];
+        columns[i].name.copy(p, 15);
+        columns[i].type.copy(p + 16, 7);
+        columns[i].unit.copy(p + 24, 7);
+    }
+
+    out = new OutputWriter(fname, std::max(blockSize, size_t(1 << 20)));
+    out->write(header);
+    out->flush();
+}
+
+ObserverColumnOutput::~ObserverColumnOutput() {
+    try {
+        close();
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl; // destructors must not throw
+    }
+}
+
+void ObserverColumnOutput::addColumn(const std::string &name,
+        const std::string &unit, int quantity, bool integer,
+        bool singlePrecision) {
+    Column c;
+    c.name = name;
+    c.unit = unit;
+    c.quantity = quantity;
+    c.integer = integer;
+    c.type = integer ? "<i4" : (singlePrecision ? "<f4" : "<f8");
+    c.size = (integer || singlePrecision) ? 4 : 8;
+    c.offset = 0;
+    columns.push_back(c);
+}
+
+void ObserverColumnOutput::writeBlock(Block &b) const {
+    if (b.rows == 0)
+        return;
+    uint32_t fields[2] = {uint32_t(b.rows), 0};
+    if (b.rows == blockRows) {
+        memcpy(&b.data[0], fields, sizeof(fields));
+        out->write(&b.data[0], blockSize);
+    } else {
+        // shorter block: move the columns together
+        size_t size = 8;
+        for (size_t i = 0; i < columns.size(); i++)
+            size += padded(b.rows * columns[i].size);
+        std::vector<char> data(size, 0);
+        memcpy(&data[0], fields, sizeof(fields));
+        size_t offset = 8;
+        for (size_t i = 0; i < columns.size(); i++) {
+            memcpy(&data[offset], &b.data[columns[i].offset], b.rows * columns[i].size);
+            offset += padded(b.rows * columns[i].size);
+        }
+        out->write(&data[0], size);
+    }
+    b.rows = 0;
+}
+
+void ObserverColumnOutput::writeBlocks() {
+    for (size_t i = 0; i < blocks.size(); i++)
+        writeBlock(blocks[i]);
+}
+
+void ObserverColumnOutput::append(Block &b, const double *values) const {
+    if (b.data.empty())
+        b.data.resize(blockSize, 0);
+    for (size_t i = 0; i < columns.size(); i++) {
+        const Column &c = columns[i];
+        char *p = &b.data[c.offset + b.rows * c.size];
+        double v = values[c.quantity];
+        if (c.integer) {
+            int32_t w = v;
+            memcpy(p, &w, 4);
+        } else if (c.size == 4) {
+            float w = v;
+            memcpy(p, &w, 4);
+        } else {
+            memcpy(p, &v, 8);
+        }
+    }
+}
+
+void ObserverColumnOutput::onDetection(Candidate *candidate) const {
+    const ParticleState &current = candidate->current;
+    const ParticleState &source = candidate->source;
+    Vector3d x = current.getPosition() / Mpc;
+    Vector3d x0 = source.getPosition() / Mpc;
+    Vector3d p = current.getDirection();
+    Vector3d p0 = source.getDirection();
+    double values[18] = {candidate->getTrajectoryLength() / Mpc,
+            double(current.getId()), double(source.getId()),
+            current.getEnergy() / EeV, source.getEnergy() / EeV,
+            x.x, x.y, x.z, x0.x, x0.y, x0.z, p.x, p.y, p.z, p0.x, p0.y, p0.z,
+            candidate->getRedshift()};
+
+    Block *b = blocks.local();
+    if (b == NULL) {
+#pragma omp critical(observerColumnOutput)
+        {
+            Block &shared = blocks.shared();
+            append(shared, values);
+            if (++shared.rows == blockRows)
+                writeBlock(shared);
+        }
+        return;
     }
+
+    append(*b, values);
+    if (++b->rows == blockRows)
+        writeBlock(*b);
+}
+
+void ObserverColumnOutput::endRun() {
+    if (closed)
+        return;
+    writeBlocks();
+    out->sync();
+}
+
+void ObserverColumnOutput::close() {
+    if (closed)
+        return;
+    closed = true;
+    writeBlocks();
+    out->close();
 }
 
-}// namespace
\ No newline at end of file
+}// namespace
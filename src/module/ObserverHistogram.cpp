@@ -0,0 +1,238 @@
+#include "grpropa/module/ObserverHistogram.h"
+#include "grpropa/Units.h"
+
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace grpropa {
+
+// HEALPix RING pixel of the direction with cos(theta) = z and longitude phi
+static long healpixRing(long nside, double z, double phi) {
+    double za = fabs(z);
+    double tt = fmod(phi, 2 * M_PI);
+    if (tt < 0)
+        tt += 2 * M_PI;
+    tt *= 2 / M_PI; // in [0, 4)
+
+    if (za <= 2. / 3) {
+        // equatorial region
+        double t1 = nside * (0.5 + tt);
+        double t2 = nside * z * 0.75;
+        long jp = long(t1 - t2); // ascending edge line
+        long jm = long(t1 + t2); // descending edge line
+        long ir = nside + 1 + jp - jm; // ring counted from z = 2/3
+        long kshift = 1 - (ir & 1);
+        long ip = (jp + jm - nside + kshift + 1) / 2;
+        ip = ((ip % (4 * nside)) + 4 * nside) % (4 * nside);
+        return 2 * nside * (nside - 1) + (ir - 1) * 4 * nside + ip;
+    }
+
+    // polar caps
+    double tp = tt - long(tt);
+    double tmp = nside * sqrt(3 * (1 - za));
+    long jp = long(tp * tmp);
+    long jm = long((1 - tp) * tmp);
+    long ir = jp + jm + 1; // ring counted from the closest pole
+    long ip = long(tt * ir) % (4 * ir);
+    if (z > 0)
+        return 2 * ir * (ir - 1) + ip;
+    return 12 * nside * nside - 2 * ir * (ir + 1) + ip;
+}
+
+HistogramAxis::HistogramAxis(HistogramQuantity quantity, size_t nBins,
+        double min, double max, bool logarithmic) :
+        quantity(quantity), nBins(nBins), min(min), max(max),
+        logarithmic(logarithmic), nside(0) {
+    if (quantity == ArrivalPixelQuantity)
+        throw std::runtime_error("HistogramAxis: use HistogramAxis(nside) for arrival directions");
+    if ((nBins == 0) || !(max > min))
+        throw std::runtime_error("HistogramAxis: needs at least one bin and max > min");
+    if (logarithmic && !(min > 0))
+        throw std::runtime_error("HistogramAxis: logarithmic bins need min > 0");
+}
+
+HistogramAxis::HistogramAxis(int nside) :
+        quantity(ArrivalPixelQuantity), nBins(12 * size_t(nside) * nside),
+        min(0), max(nBins), logarithmic(false), nside(nside) {
+    if (nside < 1)
+        throw std::runtime_error("HistogramAxis: nside has to be positive");
+}
+
+HistogramQuantity HistogramAxis::getQuantity() const {
+    return quantity;
+}
+
+size_t HistogramAxis::getBinCount() const {
+    return nBins;
+}
+
+double HistogramAxis::getEdge(size_t i) const {
+    double f = double(i) / nBins;
+    if (logarithmic)
+        return min * pow(max / min, f);
+    return min + (max - min) * f;
+}
+
+long HistogramAxis::getBin(const Candidate *c) const {
+    const ParticleState &current = c->current;
+    double v;
+    switch (quantity) {
+    case EnergyQuantity:
+        v = current.getEnergy();
+        break;
+    case SourceEnergyQuantity:
+        v = c->source.getEnergy();
+        break;
+    case DeflectionQuantity: {
+        Vector3d line = current.getPosition() - c->source.getPosition();
+        v = current.getDirection().getAngleTo(line);
+        break;
+    }
+    case TimeDelayQuantity: {
+        double d = (current.getPosition() - c->source.getPosition()).getR();
+        v = (c->getTrajectoryLength() - d) / c_light;
+        break;
+    }
+    case SourceIdQuantity:
+        v = c->source.getId();
+        break;
+    case ArrivalPixelQuantity: {
+        Vector3d d = current.getDirection() * -1;
+        return healpixRing(nside, d.z / d.getR(), atan2(d.y, d.x));
+    }
+    default:
+        return -1;
+    }
+
+    if (!((v >= min) && (v < max))) // also NaN
+        return -1;
+    double f = logarithmic ? log(v / min) / log(max / min) : (v - min) / (max - min);
+    return std::min(long(f * nBins), long(nBins) - 1);
+}
+
+ObserverHistogram::ObserverHistogram(const HistogramAxis &x) {
+    axes.push_back(x);
+    init();
+}
+
+ObserverHistogram::ObserverHistogram(const HistogramAxis &x,
+        const HistogramAxis &y) {
+    axes.push_back(x);
+    axes.push_back(y);
+    init();
+}
+
+void ObserverHistogram::init() {
+    nBins = 1;
+    for (size_t i = 0; i < axes.size(); i++)
+        nBins *= axes[i].getBinCount();
+    values.assign(nBins, 0);
+    squares.assign(nBins, 0);
+    alpha = 0;
+    referenceEnergy = EeV;
+    description = "ObserverHistogram";
+}
+
+void ObserverHistogram::setSourceSpectrumWeight(double a, double energy) {
+    alpha = a;
+    referenceEnergy = energy;
+}
+
+void ObserverHistogram::setSourceIdWeight(int id, double weight) {
+    sourceIdWeights[id] = weight;
+}
+
+void ObserverHistogram::fill(Bins &b, size_t bin, double weight) const {
+    if (b.sum.empty())
+        b.sum.resize(2 * nBins, 0);
+    b.sum[bin] += weight;
+    b.sum[nBins + bin] += weight * weight;
+}
+
+void ObserverHistogram::onDetection(Candidate *candidate) const {
+    long bin = axes[0].getBin(candidate);
+    if (bin < 0)
+        return;
+    if (axes.size() > 1) {
+        long y = axes[1].getBin(candidate);
+        if (y < 0)
+            return;
+        bin = bin * axes[1].getBinCount() + y;
+    }
+
+    double weight = 1;
+    if (alpha != 0)
+        weight *= pow(candidate->source.getEnergy() / referenceEnergy, alpha);
+    if (!sourceIdWeights.empty()) {
+        std::map<int, double>::const_iterator i = sourceIdWeights.find(candidate->source.getId());
+        if (i != sourceIdWeights.end())
+            weight *= i->second;
+    }
+
+    Bins *b = bins.local();
+    if (b == NULL) {
+#pragma omp critical(observerHistogram)
+        fill(bins.shared(), bin, weight);
+        return;
+    }
+    fill(*b, bin, weight);
+}
+
+void ObserverHistogram::endRun() {
+    for (size_t i = 0; i < bins.size(); i++) {
+        Bins &b = bins[i];
+        if (b.sum.empty())
+            continue;
+        for (size_t j = 0; j < nBins; j++) {
+            values[j] += b.sum[j];
+            squares[j] += b.sum[nBins + j];
+        }
+        std::vector<double>().swap(b.sum);
+    }
+}
+
+size_t ObserverHistogram::getDimension() const {
+    return axes.size();
+}
+
+const HistogramAxis &ObserverHistogram::getAxis(size_t i) const {
+    return axes.at(i);
+}
+
+const std::vector<double> &ObserverHistogram::getValues() const {
+    return values;
+}
+
+std::vector<double> ObserverHistogram::getUncertainties() const {
+    std::vector<double> u(nBins);
+    for (size_t i = 0; i < nBins; i++)
+        u[i] = sqrt(squares[i]);
+    return u;
+}
+
+void ObserverHistogram::clear() {
+    values.assign(nBins, 0);
+    squares.assign(nBins, 0);
+}
+
+void ObserverHistogram::save(const std::string &filename) const {
+    std::ofstream out(filename.c_str());
+    if (!out.good())
+        throw std::runtime_error("ObserverHistogram: could not open file " + filename);
+    out << "# Edges of the bins in SI units, sum of weights, uncertainty\n";
+    const HistogramAxis &x = axes[0];
+    size_t ny = (axes.size() > 1) ? axes[1].getBinCount() : 1;
+    for (size_t i = 0; i < nBins; i++) {
+        size_t ix = i / ny, iy = i % ny;
+        out << x.getEdge(ix) << "\t" << x.getEdge(ix + 1) << "\t";
+        if (axes.size() > 1)
+            out << axes[1].getEdge(iy) << "\t" << axes[1].getEdge(iy + 1) << "\t";
+        out << values[i] << "\t" << sqrt(squares[i]) << "\n";
+    }
+    if (!out.good())
+        throw std::runtime_error("ObserverHistogram: could not write file " + filename);
+}
+
+} // namespace grpropa
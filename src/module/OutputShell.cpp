@@ -42,10 +42,11 @@ std::string ShellOutput1D::getDescription() const {
 }
 
 void ShellPropertyOutput::process(Candidate* c) const {
-        PropertyMap::const_iterator i = c->properties.begin();
+    PropertyMap properties = c->getProperties();
+    PropertyMap::const_iterator i = properties.begin();
 #pragma omp critical
     {
-        for (i; i != c->properties.end(); i++) {
+        for (i; i != properties.end(); i++) {
             std::cout << "  " << i->first << ", " << i->second << std::endl;
         }
     }
@@ -1,29 +1,231 @@
 #include "grpropa/module/OutputTXT.h"
 #include "grpropa/Units.h"
-
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <stdexcept>
 
 namespace grpropa {
 
-TrajectoryOutput::TrajectoryOutput(std::string name) {
+namespace {
+
+class TrajectoryCascade;
+
+// cascades of a TrajectoryOutput that have not been released yet
+class TrajectoryCascadeList: public Referenced {
+public:
+    pthread_mutex_t mutex;
+    std::set<TrajectoryCascade *> cascades;
+    TrajectoryCascadeList() {
+        pthread_mutex_init(&mutex, 0);
+    }
+    void flush();
+protected:
+    ~TrajectoryCascadeList() {
+        pthread_mutex_destroy(&mutex);
+    }
+};
+
+// steps of a primary and all its secondaries, see TrajectoryOutput::setDetectionProperty
+class TrajectoryCascade: public Referenced {
+    ref_ptr<OutputWriter> out;
+    ref_ptr<TrajectoryCascadeList> list;
+    pthread_mutex_t mutex; // secondaries may be propagated in other threads
+    std::string lines;
+    bool detected;
+public:
+    const bool selected;
+    TrajectoryCascade(OutputWriter *out, TrajectoryCascadeList *list, bool selected) :
+            out(out), list(list), detected(false), selected(selected) {
+        pthread_mutex_init(&mutex, 0);
+        pthread_mutex_lock(&list->mutex);
+        list->cascades.insert(this);
+        pthread_mutex_unlock(&list->mutex);
+    }
+    void add(const char *line, size_t length, bool detection) {
+        pthread_mutex_lock(&mutex);
+        lines.append(line, length);
+        detected = detected || detection;
+        pthread_mutex_unlock(&mutex);
+    }
+    // write the lines so far if the cascade has been detected
+    void flush() {
+        pthread_mutex_lock(&mutex);
+        if (detected && !lines.empty()) {
+            out->write(lines);
+            lines.clear();
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+protected:
+    // the last particle of the cascade has been released
+    ~TrajectoryCascade() {
+        pthread_mutex_lock(&list->mutex);
+        list->cascades.erase(this);
+        pthread_mutex_unlock(&list->mutex);
+        try {
+            flush();
+        } catch (std::exception &e) {
+            std::cerr << e.what() << std::endl; // destructors must not throw
+        }
+        pthread_mutex_destroy(&mutex);
+    }
+};
+
+void TrajectoryCascadeList::flush() {
+    pthread_mutex_lock(&mutex);
+    try {
+        std::set<TrajectoryCascade *>::iterator i;
+        for (i = cascades.begin(); i != cascades.end(); i++)
+            (*i)->flush();
+    } catch (...) {
+        pthread_mutex_unlock(&mutex);
+        throw;
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+// state of one particle, secondaries start with the record of their parent
+struct TrajectoryRecord: public Referenced {
+    const Candidate *candidate;
+    size_t steps;
+    Vector3d position; /**< At the last written step */
+    Vector3d direction;
+    ref_ptr<TrajectoryCascade> cascade;
+};
+
+// mixes the bits of a 64 bit value (finalizer of splitmix64)
+uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t mix(uint64_t h, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return mix(h ^ bits);
+}
+
+// uniform number in [0, 1) given by the initial state of a primary
+double sampleValue(const ParticleState &source, uint64_t seed) {
+    const Vector3d &pos = source.getPosition();
+    const Vector3d &dir = source.getDirection();
+    uint64_t h = mix(seed + 0x9e3779b97f4a7c15ULL);
+    h = mix(h, pos.x);
+    h = mix(h, pos.y);
+    h = mix(h, pos.z);
+    h = mix(h, dir.x);
+    h = mix(h, dir.y);
+    h = mix(h, dir.z);
+    h = mix(h, source.getEnergy());
+    h = mix(h ^ uint64_t(uint32_t(source.getId())));
+    return (h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+} // namespace
+
+TrajectoryOutput::TrajectoryOutput(std::string name) :
+        stepInterval(1), minAngle(0), minDistance(0), sampling(1), samplingSeed(0), detectionKey(-1),
+        cascades(new TrajectoryCascadeList()) {
     setDescription("Trajectory output");
-    fout.open(name.c_str());
-    fout << "# D\tID\tE\tX\tY\tZ\tPx\tPy\tPz\n";
-    fout << "#\n";
-    fout << "# D           Trajectory length\n";
-    fout << "# ID          Particle type (PDG MC numbering scheme)\n";
-    fout << "# E           Energy [EeV]\n";
-    fout << "# X, Y, Z     Position [Mpc]\n";
-    fout << "# Px, Py, Pz  Heading (unit vector of momentum)\n";
-    fout << "#\n";
+    out = new OutputWriter(name);
+    out->write("# D\tID\tE\tX\tY\tZ\tPx\tPy\tPz\n");
+    out->write("#\n");
+    out->write("# D           Trajectory length\n");
+    out->write("# ID          Particle type (PDG MC numbering scheme)\n");
+    out->write("# E           Energy [EeV]\n");
+    out->write("# X, Y, Z     Position [Mpc]\n");
+    out->write("# Px, Py, Pz  Heading (unit vector of momentum)\n");
+    out->write("#\n");
+    out->flush();
+}
+
+void TrajectoryOutput::setStepInterval(size_t n) {
+    stepInterval = std::max(n, size_t(1));
+}
+
+void TrajectoryOutput::setMinAngle(double angle) {
+    minAngle = angle;
 }
 
-TrajectoryOutput::~TrajectoryOutput() {
-    fout.close();
+void TrajectoryOutput::setMinDistance(double distance) {
+    minDistance = distance;
+}
+
+void TrajectoryOutput::setSampling(double fraction, unsigned int seed) {
+    sampling = fraction;
+    samplingSeed = seed;
+}
+
+void TrajectoryOutput::setDetectionProperty(std::string property) {
+    detectionKey = property.empty() ? -1 : Candidate::internProperty(property);
+}
+
+bool TrajectoryOutput::recording() const {
+    return (stepInterval > 1) || (minAngle > 0) || (minDistance > 0)
+            || (sampling < 1) || (detectionKey >= 0);
 }
 
 void TrajectoryOutput::process(Candidate *c) const {
     char buffer[1024];
+    if (!recording()) {
+        out->write(buffer, format(c, buffer));
+        return;
+    }
+
+    // record of this particle, new for primaries and secondaries
+    TrajectoryRecord *r = static_cast<TrajectoryRecord *>(c->getRecord(this));
+    if ((r == NULL) || (r->candidate != c)) {
+        TrajectoryRecord *parent = r;
+        r = new TrajectoryRecord();
+        r->candidate = c;
+        r->steps = 0;
+        if (parent != NULL)
+            r->cascade = parent->cascade;
+        else
+            r->cascade = new TrajectoryCascade(out,
+                    static_cast<TrajectoryCascadeList *>(cascades.get()),
+                    (sampling >= 1) || (sampleValue(c->source, samplingSeed) < sampling));
+        c->setRecord(this, r);
+    }
+    if (!r->cascade->selected)
+        return;
+
+    const Vector3d &pos = c->current.getPosition();
+    const Vector3d &dir = c->current.getDirection();
+    bool write = (r->steps == 0) || !c->isActive();
+    if ((stepInterval > 1) && (r->steps % stepInterval == 0))
+        write = true;
+    if ((minAngle > 0) && (dir.getAngleTo(r->direction) > minAngle))
+        write = true;
+    if ((minDistance > 0) && ((pos - r->position).getR() > minDistance))
+        write = true;
+    if ((stepInterval <= 1) && (minAngle <= 0) && (minDistance <= 0))
+        write = true; // only sampling or detection
+    r->steps++;
+    if (write) {
+        r->position = pos;
+        r->direction = dir;
+    }
+
+    if (detectionKey < 0) {
+        if (write)
+            out->write(buffer, format(c, buffer));
+        return;
+    }
+    bool detected = c->hasProperty(detectionKey);
+    if (write)
+        r->cascade->add(buffer, format(c, buffer), detected);
+    else if (detected)
+        r->cascade->add(buffer, 0, true);
+}
+
+size_t TrajectoryOutput::format(Candidate *c, char *buffer) const {
     size_t p = 0;
 
     p += sprintf(buffer + p, "%8.3f\t", c->getTrajectoryLength() / Mpc);
@@ -33,40 +235,43 @@ void TrajectoryOutput::process(Candidate *c) const {
     p += sprintf(buffer + p, "%8.8f\t%8.8f\t%8.8f\t", pos.x, pos.y, pos.z);
     const Vector3d &dir = c->current.getDirection();
     p += sprintf(buffer + p, "%8.5f\t%8.5f\t%8.5f\n", dir.x, dir.y, dir.z);
+    return p;
+}
 
-#pragma omp critical
-    {
-        fout.write(buffer, p);
-        fout.flush();
-    }
+void TrajectoryOutput::endRun() {
+    // cascades still held by the caller, e.g. of a run over a candidate vector
+    static_cast<TrajectoryCascadeList *>(cascades.get())->flush();
+    out->sync();
+}
+
+void TrajectoryOutput::close() {
+    static_cast<TrajectoryCascadeList *>(cascades.get())->flush();
+    out->close();
 }
 
 ConditionalOutput::ConditionalOutput(std::string fname, std::string cond) :
-        condition(cond) {
+        condition(cond), conditionKey(Candidate::internProperty(cond)) {
     setDescription(
             "Conditional output, condition: " + cond + ", filename: " + fname);
-    fout.open(fname.c_str());
-    fout << "# D\tID\tID0\tE\tE0\tX\tY\tZ\tX0\tY0\tZ0\tPx\tPy\tPz\tP0x\tP0y\tP0z\tz\n";
-    fout << "#\n";
-    fout << "# D           Trajectory length [Mpc]\n";
-    fout << "# ID          Particle type (PDG MC numbering scheme)\n";
-    fout << "# E           Energy [EeV]\n";
-    fout << "# X, Y, Z     Position [Mpc]\n";
-    fout << "# Px, Py, Pz  Heading (unit vector of momentum)\n";
-    fout << "# z           Current redshift\n";
-    fout << "# Initial state: ID0, E0, ...\n";
-    fout << "#\n";
-}
-
-ConditionalOutput::~ConditionalOutput() {
-    fout.close();
+    out = new OutputWriter(fname);
+    out->write("# D\tID\tID0\tE\tE0\tX\tY\tZ\tX0\tY0\tZ0\tPx\tPy\tPz\tP0x\tP0y\tP0z\tz\n");
+    out->write("#\n");
+    out->write("# D           Trajectory length [Mpc]\n");
+    out->write("# ID          Particle type (PDG MC numbering scheme)\n");
+    out->write("# E           Energy [EeV]\n");
+    out->write("# X, Y, Z     Position [Mpc]\n");
+    out->write("# Px, Py, Pz  Heading (unit vector of momentum)\n");
+    out->write("# z           Current redshift\n");
+    out->write("# Initial state: ID0, E0, ...\n");
+    out->write("#\n");
+    out->flush();
 }
 
 void ConditionalOutput::process(Candidate *c) const {
-    if (not (c->hasProperty(condition)))
+    if (not (c->hasProperty(conditionKey)))
         return;
 
-    c->removeProperty(condition);
+    c->removeProperty(conditionKey);
 
     char buffer[256];
     size_t p = 0;
@@ -86,25 +291,26 @@ void ConditionalOutput::process(Candidate *c) const {
     p += sprintf(buffer + p, "%8.5f\t%8.5f\t%8.5f\t", idir.x, idir.y, idir.z);
     p += sprintf(buffer + p, "%1.3f\n", c->getRedshift());
 
-#pragma omp critical
-    {
-        fout.write(buffer, p);
-        fout.flush();
-    }
+    out->write(buffer, p);
 }
 
-TrajectoryOutput1D::TrajectoryOutput1D(std::string filename) {
-    setDescription("TrajectoryOutput, filename: " + filename);
-    fout.open(filename.c_str());
-    fout << "#X\tID\tE\n";
-    fout << "#\n";
-    fout << "# X  Position [Mpc]\n";
-    fout << "# ID Particle type\n";
-    fout << "# E  Energy [EeV]\n";
+void ConditionalOutput::endRun() {
+    out->sync();
 }
 
-TrajectoryOutput1D::~TrajectoryOutput1D() {
-    fout.close();
+void ConditionalOutput::close() {
+    out->close();
+}
+
+TrajectoryOutput1D::TrajectoryOutput1D(std::string filename) {
+    setDescription("TrajectoryOutput, filename: " + filename);
+    out = new OutputWriter(filename);
+    out->write("#X\tID\tE\n");
+    out->write("#\n");
+    out->write("# X  Position [Mpc]\n");
+    out->write("# ID Particle type\n");
+    out->write("# E  Energy [EeV]\n");
+    out->flush();
 }
 
 void TrajectoryOutput1D::process(Candidate *c) const {
@@ -113,34 +319,36 @@ void TrajectoryOutput1D::process(Candidate *c) const {
     p += sprintf(buffer + p, "%8.4f\t", c->current.getPosition().x / Mpc);
     p += sprintf(buffer + p, "%10i\t", c->current.getId());
     p += sprintf(buffer + p, "%.4g\n", c->current.getEnergy() / eV);
-#pragma omp critical
-    {
-        fout.write(buffer, p);
-        fout.flush();
-    }
+    out->write(buffer, p);
 }
 
-EventOutput1D::EventOutput1D(std::string filename) {
-    setDescription("Conditional output, filename: " + filename);
-    fout.open(filename.c_str());
-    fout << "#ID\tE\tD\tID0\tE0\n";
-    fout << "#\n";
-    fout << "# ID  Particle type\n";
-    fout << "# E   Energy [EeV]\n";
-    fout << "# D   Comoving source distance [Mpc]\n";
-    fout << "# ID0 Initial particle type\n";
-    fout << "# E0  Initial energy [EeV]\n";
+void TrajectoryOutput1D::endRun() {
+    out->sync();
 }
 
-EventOutput1D::~EventOutput1D() {
-    fout.close();
+void TrajectoryOutput1D::close() {
+    out->close();
+}
+
+EventOutput1D::EventOutput1D(std::string filename) :
+        detectedKey(Candidate::internProperty("Detected")) {
+    setDescription("Conditional output, filename: " + filename);
+    out = new OutputWriter(filename);
+    out->write("#ID\tE\tD\tID0\tE0\n");
+    out->write("#\n");
+    out->write("# ID  Particle type\n");
+    out->write("# E   Energy [EeV]\n");
+    out->write("# D   Comoving source distance [Mpc]\n");
+    out->write("# ID0 Initial particle type\n");
+    out->write("# E0  Initial energy [EeV]\n");
+    out->flush();
 }
 
 void EventOutput1D::process(Candidate *c) const {
-    if (not (c->hasProperty("Detected")))
+    if (not (c->hasProperty(detectedKey)))
         return;
 
-    c->removeProperty("Detected");
+    c->removeProperty(detectedKey);
 
     char buffer[256];
     size_t p = 0;
@@ -151,11 +359,15 @@ void EventOutput1D::process(Candidate *c) const {
     p += sprintf(buffer + p, "%10i\t", c->source.getId());
     p += sprintf(buffer + p, "%.4g\n", c->source.getEnergy() / eV);
 
-#pragma omp critical
-    {
-        fout.write(buffer, p);
-        fout.flush();
-    }
+    out->write(buffer, p);
+}
+
+void EventOutput1D::endRun() {
+    out->sync();
+}
+
+void EventOutput1D::close() {
+    out->close();
 }
 
 } // namespace grpropa
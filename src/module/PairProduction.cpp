@@ -2,7 +2,6 @@
 #include "grpropa/Random.h"
 #include "grpropa/Units.h"
 
-#include <fstream>
 #include <limits>
 #include <stdexcept>
 
@@ -16,6 +15,7 @@ PairProduction::PairProduction(PhotonField photonField, double limit, double nMa
 
 void PairProduction::setPhotonField(PhotonField photonField) {
     this->photonField = photonField;
+    rateTable = NULL; // not every photon field provides rates
     switch (photonField) {
     case CMB:
         redshiftDependence = false;
@@ -89,169 +89,11 @@ void PairProduction::setLimit(double limit) {
 }
 
 void PairProduction::initRate(std::string filename) {
-    
-    if (redshiftDependence == false) {
-        std::ifstream infile(filename.c_str());
-        if (!infile.good())
-            throw std::runtime_error("PairProduction: could not open file " + filename);
-   
-        // clear previously loaded interaction rates
-        tabEnergy.clear();
-        tabRate.clear();
-
-        while (infile.good()) {
-            if (infile.peek() != '#') {
-                double a, b;
-                infile >> a >> b;
-                if (infile) {
-                    tabEnergy.push_back(a * eV);
-                    tabRate.push_back(b / Mpc);
-                }
-            }
-            infile.ignore(std::numeric_limits < std::streamsize > ::max(), '\n');
-        }
-        infile.close();
-    } else { // Rates for EBL
-        std::ifstream infile(filename.c_str());
-        if (!infile.good())
-            throw std::runtime_error("PairProduction: could not open file " + filename);
-  
-        // clear previously loaded interaction rates
-        tabEnergy.clear();
-        tabRate.clear();
-        tabRedshift.clear();
-
-        // size of vector is predefined and depends on the model
-        int nc; // number of columns (redshifts + one column for energy)
-        int nl = 81; // number of lines (energies)
-        std::vector<double> redshifts;
-        if (photonField == EBL_Finke10) {
-            nc = 33;
-            double redshifts[] = {0.00, 0.01, 0.02, 0.03, 0.04, 0.05, 0.07, 0.09, 0.10, 0.15, 0.20, 0.25, 0.30, 0.35, 0.40, 0.45, 0.50, 0.60, 0.70, 0.80, 0.90, 1.00, 1.20, 1.40, 1.60, 1.80, 2.00, 2.50, 3.00, 3.50, 4.00, 4.50, 4.99};
-            for (int k=0; k<nc; k++) 
-                tabRedshift.push_back(redshifts[k]);
-        }
-        else if (photonField == EBL_Gilmore12) {
-            nc = 20;
-            double redshifts[] = {0, 0.015, 0.025, 0.044, 0.05, 0.2, 0.4, 0.5, 0.6, 0.8, 1.0, 1.25, 1.5, 2.0, 2.5, 3.0, 4.0, 5.0, 6.0, 7.0};
-            for (int k=0; k<nc; k++) 
-                tabRedshift.push_back(redshifts[k]);
-        }
-        else if (photonField == EBL_Dominguez11 || photonField == EBL_Dominguez11_UL || photonField == EBL_Dominguez11_LL) {
-            nc = 20;
-            double redshifts[] = {0, 0.01, 0.03, 0.05, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.8, 1.0, 1.25, 1.5, 2.0, 2.5, 3.0, 3.9};
-            for (int k=0; k<nc; k++) 
-                tabRedshift.push_back(redshifts[k]);
-        }
-        else if (photonField == EBL_Kneiske10) {
-            nc = 5;
-            double redshifts[] = {0.0, 0.1, 0.3, 0.8, 2.0};
-            for (int k=0; k<nc; k++) 
-                tabRedshift.push_back(redshifts[k]);
-        }
-        else if (photonField == EBL_Franceschini08) {
-            nc = 11;
-            double redshifts[] = {0.0, 0.2, 0.4, 0.6, 0.8, 1.0, 1.2, 1.4, 1.6, 1.8, 2.0};
-            for (int k=0; k<nc; k++) 
-                tabRedshift.push_back(redshifts[k]);
-        }
-        else { 
-            throw std::runtime_error("EBL model not defined for redshift dependent treatment (or not defined at all).");
-        }
-
-        double entries[nc+1][nl];
-        int j = 0;
-        while (!infile.eof()) {
-            for (int i=0; i<nc+1; i++) {
-                double entry = 0;
-                infile >> entry;
-                entries[i][j] = entry;
-            }
-            j++;
-        }
-
-        for (int j=0; j<nl; j++) 
-            tabEnergy.push_back(entries[0][j] * eV);
-        for (int i=1; i<nc+1; i++){
-            for (int j=0; j<nl; j++){
-                tabRate.push_back(entries[i][j] / Mpc);
-            }
-        }
-        infile.close();
-    } // conditional: redshift dependent
-
-    // for (int i=0; i<tabRate.size(); i++) std::cout << tabRate[i] * Mpc << std::endl;
-    // for (int i=0; i<tabEnergy.size(); i++) std::cout << tabEnergy[i] /eV << std::endl;
+    rateTable = getInteractionRateTable(filename, photonField);
 }
 
 void PairProduction::initTableBackgroundEnergy(std::string filename) {
-
-    if (redshiftDependence == false) {
-        std::ifstream infile(filename.c_str());
-        if (!infile.good())
-            throw std::runtime_error("PairProduction: could not open file " + filename);
-   
-        // clear previously loaded interaction rates
-        tabPhotonEnergy.clear();
-        tabProb.clear();
-
-        while (infile.good()) {
-            if (infile.peek() != '#') {
-                double a, b;
-                infile >> b >> a;
-                if (infile) {
-                    tabPhotonEnergy.push_back(a * eV);
-                    tabProb.push_back(b);
-                }
-            }
-            infile.ignore(std::numeric_limits < std::streamsize > ::max(), '\n');
-        }
-        infile.close();
-    } else { // Rates for EBL
-        std::ifstream infile(filename.c_str());
-        if (!infile.good())
-            throw std::runtime_error("PairProduction: could not open file " + filename);
-  
-        // clear previously loaded interaction rates
-        tabPhotonEnergy.clear();
-        tabProb.clear();
-
-        // size of vector is predefined and depends on the model
-        int nc; // number of columns (redshifts + one column for energy)
-        int nl = 400; // number of lines (probabilities)
-
-        if (photonField == EBL_Finke10) nc = 33;
-        else if (photonField == EBL_Gilmore12) nc = 20;
-        else if (photonField == EBL_Kneiske10) nc = 5;
-        else if (photonField == EBL_Franceschini08) nc = 11;
-        else if (photonField == EBL_Dominguez11 || photonField == EBL_Dominguez11_UL || photonField == EBL_Dominguez11_LL) nc = 18;
-        else throw std::runtime_error("EBL model not defined for redshift dependent treatment (or not defined at all).");
-
-        double entries[nc+1][nl];
-        int j = 0;
-        while (!infile.eof()) {
-            for (int i=0; i<nc+1; i++) {
-                double entry = 0;
-                infile >> entry;
-                entries[i][j] = entry;
-            }
-            j++;
-        }
-
-        for (int j=0; j<nl; j++) 
-            tabProb.push_back(entries[0][j]);
-        for (int i=1; i<nc+1; i++){
-            for (int j=0; j<nl; j++){
-                tabPhotonEnergy.push_back(entries[i][j] * eV);
-            }
-        }
-        infile.close();
-
-        // test
-        // for (int i=0; i<tabPhotonEnergy.size(); i++) std::cout << tabPhotonEnergy[i] / eV << std::endl;
-        // for (int i=0; i<tabProb.size(); i++) std::cout << tabProb[i] << std::endl;
-        // for (int i=0; i<tabRedshift.size(); i++) std::cout << tabRedshift[i] << std::endl;
-    } // conditional: redshift dependent
+    photonTable = getPhotonEnergyTable(filename, photonField);
 }
 
 double PairProduction::energyFraction(double E, double z) const {
@@ -267,21 +109,23 @@ double PairProduction::energyFraction(double E, double z) const {
     */
     Random &random = Random::instance();
 
+    // below emin the pair threshold s >= 4 m^2 c^4 is not reached at any angle,
+    // so only the part of the spectrum above emin is sampled
+    double emin = pow(mass_electron * c_squared, 2) / E;
+    const PhotonEnergySampler &sampler = photonTable->sampler;
+    PhotonEnergySampler::Range range = sampler.getRange(z, emin);
+
     double s = 0;
     int errCounter = 0;
     int nMaxIterations = this->nMaxIterations;
     do {
-        if (errCounter >= nMaxIterations) {
+        if (errCounter >= nMaxIterations || range.empty) {
             if (E > 4 * pow(mass_electron * c_squared, 2))
                 return 0.5;
             else
                 return -1;
         }
-        double e;    
-        if (redshiftDependence == true)
-            e = interpolate2d(z, random.rand(), tabRedshift, tabProb, tabPhotonEnergy);
-        else
-            e = (1 + z) * interpolate(random.rand(), tabProb, tabPhotonEnergy);
+        double e = sampler.sample(range, random.rand());
 
         // kinematics
         double mu = random.randUniform(-1, 1);  
@@ -319,6 +163,11 @@ double PairProduction::lossLength(int id, double en, double z) const {
     if (id != 22)
         return std::numeric_limits<double>::max(); // no pair production on uncharged particles
 
+    if (!rateTable)
+        throw std::runtime_error("PairProduction: no interaction rates loaded for " + getDescription());
+
+    const std::vector<double> &tabEnergy = rateTable->energies;
+    const std::vector<double> &tabRate = rateTable->rates;
     if (en < tabEnergy.front())
         return std::numeric_limits<double>::max(); // below energy threshold
 
@@ -326,13 +175,13 @@ double PairProduction::lossLength(int id, double en, double z) const {
     if (redshiftDependence == false) {
         en *= (1 + z);
         if (en < tabEnergy.back())
-            rate = interpolate(en, tabEnergy, tabRate); // interpolation
+            rate = interpolate(en, rateTable->energyAxis, tabRate); // interpolation
         else
             rate = tabRate.back() * pow(en / tabEnergy.back(), -0.6); // extrapolation
         rate *= pow(1 + z, 3);  
     } else {
         if (en < tabEnergy.back())
-            rate = interpolate2d(z, en, tabRedshift, tabEnergy, tabRate); // interpolation
+            rate = interpolate2d(z, en, rateTable->redshiftAxis, rateTable->energyAxis, tabRate); // interpolation
         else
             rate = tabRate.back() * pow(en / tabEnergy.back(), -0.6); // extrapolation
     }
@@ -1,78 +1,206 @@
 #include "grpropa/module/PropagationCK.h"
+#include "grpropa/magneticField/MagneticFieldGrid.h"
+#include "grpropa/ThreadSlots.h"
 
+#include <algorithm>
 #include <limits>
 #include <sstream>
 #include <stdexcept>
-#include <vector>
 
 namespace grpropa {
 
-// Cash-Karp coefficients
-const double cash_karp_a[] = { 0., 0., 0., 0., 0., 0., 1. / 5., 0., 0., 0., 0., 0., 3. / 40., 9. / 40., 0., 0., 0., 0., 3. / 10., -9. / 10., 6. / 5., 0., 0., 0., -11. / 54., 5. / 2., -70. / 27., 35. / 27., 0., 0., 1631. / 55296., 175. / 512., 575. / 13824., 44275. / 110592., 253. / 4096., 0. };
+/*
+ Butcher tableaus of the embedded methods: the stage coefficients a, the
+ weights b of the propagated solution and the weights e = b - b* of the error
+ estimate. The error scales with h^-1/errorExponent. With fsal set the last
+ stage is evaluated at the end point of the step (its row of a equals b).
+ */
+struct CashKarpTableau {
+    enum {
+        stages = 6, fsal = 0
+    };
+    static const double a[6][6], b[6], e[6], errorExponent;
+};
 
-const double cash_karp_b[] = { 37. / 378., 0, 250. / 621., 125. / 594., 0., 512. / 1771. };
+const double CashKarpTableau::a[6][6] = {
+    { 0., 0., 0., 0., 0., 0. },
+    { 1. / 5., 0., 0., 0., 0., 0. },
+    { 3. / 40., 9. / 40., 0., 0., 0., 0. },
+    { 3. / 10., -9. / 10., 6. / 5., 0., 0., 0. },
+    { -11. / 54., 5. / 2., -70. / 27., 35. / 27., 0., 0. },
+    { 1631. / 55296., 175. / 512., 575. / 13824., 44275. / 110592., 253. / 4096., 0. } };
+const double CashKarpTableau::b[6] = { 37. / 378., 0, 250. / 621., 125. / 594., 0., 512. / 1771. };
+const double CashKarpTableau::e[6] = { 37. / 378. - 2825. / 27648., 0., 250. / 621. - 18575. / 48384.,
+        125. / 594. - 13525. / 55296., 0. - 277. / 14336., 512. / 1771. - 1. / 4. };
+const double CashKarpTableau::errorExponent = -0.2;
 
-const double cash_karp_bs[] = { 2825. / 27648., 0., 18575. / 48384., 13525. / 55296., 277. / 14336., 1. / 4. };
+struct DormandPrinceTableau {
+    enum {
+        stages = 7, fsal = 1
+    };
+    static const double a[7][7], b[7], e[7], errorExponent;
+};
 
-void PropagationCK::tryStep(const Y &y, Y &out, Y &error, double h, ParticleState &particle) const {
-    std::vector<Y> k;
-    k.reserve(6);
+const double DormandPrinceTableau::a[7][7] = {
+    { 0., 0., 0., 0., 0., 0., 0. },
+    { 1. / 5., 0., 0., 0., 0., 0., 0. },
+    { 3. / 40., 9. / 40., 0., 0., 0., 0., 0. },
+    { 44. / 45., -56. / 15., 32. / 9., 0., 0., 0., 0. },
+    { 19372. / 6561., -25360. / 2187., 64448. / 6561., -212. / 729., 0., 0., 0. },
+    { 9017. / 3168., -355. / 33., 46732. / 5247., 49. / 176., -5103. / 18656., 0., 0. },
+    { 35. / 384., 0., 500. / 1113., 125. / 192., -2187. / 6784., 11. / 84., 0. } };
+const double DormandPrinceTableau::b[7] = { 35. / 384., 0., 500. / 1113., 125. / 192., -2187. / 6784., 11. / 84., 0. };
+const double DormandPrinceTableau::e[7] = { 35. / 384. - 5179. / 57600., 0., 500. / 1113. - 7571. / 16695.,
+        125. / 192. - 393. / 640., -2187. / 6784. + 92097. / 339200., 11. / 84. - 187. / 2100., -1. / 40. };
+const double DormandPrinceTableau::errorExponent = -0.2;
 
-    out = y;
-    error = Y(0);
+struct BogackiShampineTableau {
+    enum {
+        stages = 4, fsal = 1
+    };
+    static const double a[4][4], b[4], e[4], errorExponent;
+};
+
+const double BogackiShampineTableau::a[4][4] = {
+    { 0., 0., 0., 0. },
+    { 1. / 2., 0., 0., 0. },
+    { 0., 3. / 4., 0., 0. },
+    { 2. / 9., 1. / 3., 4. / 9., 0. } };
+const double BogackiShampineTableau::b[4] = { 2. / 9., 1. / 3., 4. / 9., 0. };
+const double BogackiShampineTableau::e[4] = { 2. / 9. - 7. / 24., 1. / 3. - 1. / 4., 4. / 9. - 1. / 3., -1. / 8. };
+const double BogackiShampineTableau::errorExponent = -1. / 3.;
+
+// number of charged candidates that are integrated together in a batch
+const size_t ckLanes = 16;
+
+namespace {
 
-    // calculate the sum of b_i * k_i
-    for (size_t i = 0; i < 6; i++) {
+const size_t fieldCacheSize = 256;
+
+// field at the end points of the last steps of a thread, one entry per
+// charged candidate of a batch (single candidates use the first), see first same as last
+struct FieldCache {
+    const MagneticField *field[fieldCacheSize];
+    double x[fieldCacheSize][3];
+    double B[fieldCacheSize][3];
+
+    bool lookup(size_t slot, const MagneticField *f, const Vector3d &position, double *b) const {
+        size_t lane = slot % fieldCacheSize;
+        if (field[lane] != f || x[lane][0] != position.x || x[lane][1] != position.y || x[lane][2] != position.z)
+            return false;
+        b[0] = B[lane][0];
+        b[1] = B[lane][1];
+        b[2] = B[lane][2];
+        return true;
+    }
+
+    void store(size_t slot, const MagneticField *f, const double *position, const double *b) {
+        size_t lane = slot % fieldCacheSize;
+        field[lane] = f;
+        for (size_t c = 0; c < 3; c++) {
+            x[lane][c] = position[c];
+            B[lane][c] = b[c];
+        }
+    }
+};
 
-        Y y_n = y;
+#ifdef _MSC_VER
+__declspec(align(64)) ThreadSlots<FieldCache> fieldCaches;
+#else
+__attribute__ ((aligned(64))) ThreadSlots<FieldCache> fieldCaches;
+#endif
+
+// dY/dt for q*c/E = qc in the field B, see PropagationCK::dYdt
+PropagationCK::Y derivative(const PropagationCK::Y &y, double qc, const Vector3d &B) {
+    Vector3d velocity = y.u.getUnitVector() * c_light;
+    return PropagationCK::Y(velocity, qc * velocity.cross(B));
+}
+
+template<class T>
+void tryStepWith(const PropagationCK &propagation, const PropagationCK::Y &y,
+        PropagationCK::Y &out, PropagationCK::Y &error, double h, ParticleState &particle) {
+    PropagationCK::Y k[T::stages];
+    out = y;
+    error = PropagationCK::Y(0);
+    for (size_t i = 0; i < T::stages; i++) {
+        PropagationCK::Y y_n = y;
         for (size_t j = 0; j < i; j++)
-            y_n += k[j] * a[i * 6 + j] * h;
+            y_n += k[j] * T::a[i][j] * h;
+        k[i] = propagation.dYdt(y_n, particle);
+        out += k[i] * T::b[i] * h;
+        error += k[i] * T::e[i] * h;
+    }
+}
 
-        // update k_i
-        k[i] = dYdt(y_n, particle);
+} // namespace
 
-        out += k[i] * b[i] * h;
-        error += k[i] * (b[i] - bs[i]) * h;
+void PropagationCK::tryStep(const Y &y, Y &out, Y &error, double h, ParticleState &particle) const {
+    switch (method) {
+    case DormandPrince:
+        tryStepWith<DormandPrinceTableau>(*this, y, out, error, h, particle);
+        break;
+    case BogackiShampine:
+        tryStepWith<BogackiShampineTableau>(*this, y, out, error, h, particle);
+        break;
+    default:
+        tryStepWith<CashKarpTableau>(*this, y, out, error, h, particle);
     }
 }
 
-PropagationCK::Y PropagationCK::dYdt(const Y &y, ParticleState &p) const {
-    // normalize direction vector to prevent numerical losses
-    Vector3d velocity = y.u.getUnitVector() * c_light;
-    Vector3d B(0, 0, 0);
+Vector3d PropagationCK::getFieldAt(const Vector3d &position, VectorGridCursor &cursor) const {
+    if (gridField)
+        return gridField->getField(position, cursor);
     try {
-        B = field->getField(y.x);
+        return field->getField(position);
     } catch (std::exception &e) {
         std::cerr << "PropagationCK: Exception in getField." << std::endl;
         std::cerr << e.what() << std::endl;
     }
-    // Lorentz force: du/dt = q*c/E * (v x B)
-    Vector3d dudt = p.getCharge() * c_light / p.getEnergy() * velocity.cross(B);
-    return Y(velocity, dudt);
+    return Vector3d(0, 0, 0);
+}
+
+void PropagationCK::getFieldsAt(const double *xyz, double *B, size_t n, VectorGridCursor *cursors, const size_t *lanes) const {
+    if (gridField) {
+        for (size_t i = 0; i < n; i++) {
+            const double *p = xyz + 3 * i;
+            Vector3d b = gridField->getField(Vector3d(p[0], p[1], p[2]), cursors[lanes ? lanes[i] : i]);
+            B[3 * i] = b.x;
+            B[3 * i + 1] = b.y;
+            B[3 * i + 2] = b.z;
+        }
+        return;
+    }
+    try {
+        field->getFields(xyz, B, n);
+    } catch (std::exception &e) {
+        std::cerr << "PropagationCK: Exception in getFields." << std::endl;
+        std::cerr << e.what() << std::endl;
+        std::fill(B, B + 3 * n, 0.);
+    }
+}
+
+PropagationCK::Y PropagationCK::dYdt(const Y &y, ParticleState &p) const {
+    // Lorentz force: du/dt = q*c/E * (v x B), the direction is normalized to prevent numerical losses
+    VectorGridCursor cursor;
+    return derivative(y, p.getCharge() * c_light / p.getEnergy(), getFieldAt(y.x, cursor));
 }
 
 PropagationCK::PropagationCK(ref_ptr<MagneticField> field, double tolerance, double minStep, double maxStep) :
-        minStep(0) {
+        method(CashKarp), gridField(0), minStep(0) {
     setField(field);
     setTolerance(tolerance);
     setMaximumStep(maxStep);
     setMinimumStep(minStep);
-
-    // load Cash-Karp coefficients
-    a.assign(cash_karp_a, cash_karp_a + 36);
-    b.assign(cash_karp_b, cash_karp_b + 6);
-    bs.assign(cash_karp_bs, cash_karp_bs + 6);
 }
 
 void PropagationCK::process(Candidate *candidate) const {
-    // save the new previous particle state
     ParticleState &current = candidate->current;
-    candidate->previous = current;
-
-    double step = clip(candidate->getNextStep(), minStep, maxStep);
 
     // rectilinear propagation for neutral particles
     if (current.getCharge() == 0) {
+        // save the new previous particle state
+        candidate->previous = current;
+        double step = clip(candidate->getNextStep(), minStep, maxStep);
         Vector3d pos = current.getPosition();
         Vector3d dir = current.getDirection();
         current.setPosition(pos + dir * step);
@@ -81,34 +209,276 @@ void PropagationCK::process(Candidate *candidate) const {
         return;
     }
 
-    Y yIn(current.getPosition(), current.getDirection());
-    Y yOut, yErr;
-    double h = step / c_light;
+    switch (method) {
+    case DormandPrince:
+        step<DormandPrinceTableau>(candidate);
+        break;
+    case BogackiShampine:
+        step<BogackiShampineTableau>(candidate);
+        break;
+    default:
+        step<CashKarpTableau>(candidate);
+    }
+}
+
+template<class T>
+void PropagationCK::step(Candidate *candidate) const {
+    // save the new previous particle state
+    ParticleState &current = candidate->current;
+    candidate->previous = current;
+
+    double qc = current.getCharge() * c_light / current.getEnergy();
+    Y y(current.getPosition(), current.getDirection());
+    Y k[T::stages];
+    Y out, error;
+    double h = clip(candidate->getNextStep(), minStep, maxStep) / c_light;
     double hTry, r;
 
+    // the first stage does not depend on the step size, all tries share it
+    VectorGridCursor cursor;
+    FieldCache *cache = fieldCaches.local();
+    double B[3];
+    Vector3d B0;
+    if (T::fsal && cache && cache->lookup(0, field, y.x, B))
+        B0 = Vector3d(B[0], B[1], B[2]);
+    else
+        B0 = getFieldAt(y.x, cursor);
+    k[0] = derivative(y, qc, B0);
+
     // try performing a steps until the relative error is less than the desired
     // tolerance or the minimum step size has been reached
+    Vector3d xLast, BLast;
     do {
         hTry = h;
-        tryStep(yIn, yOut, yErr, hTry, current);
+        for (size_t i = 1; i < T::stages; i++) {
+            Y y_n = y;
+            for (size_t j = 0; j < i; j++)
+                y_n += k[j] * T::a[i][j] * hTry;
+            xLast = y_n.x;
+            BLast = getFieldAt(y_n.x, cursor);
+            k[i] = derivative(y_n, qc, BLast);
+        }
+
+        out = y;
+        error = Y(0);
+        for (size_t i = 0; i < T::stages; i++) {
+            out += k[i] * T::b[i] * hTry;
+            error += k[i] * T::e[i] * hTry;
+        }
 
         // determine absolute direction error relative to tolerance
-        r = yErr.u.getR() / tolerance;
+        r = error.u.getR() / tolerance;
         // new step size to keep the error close to the tolerance
-        h *= 0.95 * pow(r, -0.2);
+        h *= 0.95 * pow(r, T::errorExponent);
         // limit change of new step size
         h = clip(h, 0.1 * hTry, 5 * hTry);
 
     } while (r > 1 && h > minStep);
 
-    current.setPosition(yOut.x);
-    current.setDirection(yOut.u.getUnitVector());
+    // the last stage was evaluated at the end point, where the next step starts
+    if (T::fsal && cache) {
+        double x[3] = { xLast.x, xLast.y, xLast.z };
+        double b[3] = { BLast.x, BLast.y, BLast.z };
+        cache->store(0, field, x, b);
+    }
+
+    current.setPosition(out.x);
+    current.setDirection(out.u.getUnitVector());
     candidate->setCurrentStep(hTry * c_light);
     candidate->setNextStep(h * c_light);
 }
 
+void PropagationCK::process(Candidate **candidates, size_t n) const {
+    Candidate *lanes[ckLanes];
+    size_t nLanes = 0, nCharged = 0;
+    for (size_t i = 0; i < n; i++) {
+        // neutral particles only take the rectilinear step
+        if (candidates[i]->current.getCharge() == 0) {
+            process(candidates[i]);
+            continue;
+        }
+        lanes[nLanes++] = candidates[i];
+        if (nLanes == ckLanes) {
+            stepCharged(lanes, nLanes, nCharged);
+            nCharged += nLanes;
+            nLanes = 0;
+        }
+    }
+    // the remaining charged particles, also if the batch ends with neutral ones
+    if (nLanes > 0)
+        stepCharged(lanes, nLanes, nCharged);
+}
+
+void PropagationCK::stepCharged(Candidate **candidates, size_t n, size_t first) const {
+    switch (method) {
+    case DormandPrince:
+        stepLanes<DormandPrinceTableau>(candidates, n, first);
+        break;
+    case BogackiShampine:
+        stepLanes<BogackiShampineTableau>(candidates, n, first);
+        break;
+    default:
+        stepLanes<CashKarpTableau>(candidates, n, first);
+    }
+}
+
+template<class T>
+void PropagationCK::stepLanes(Candidate **candidates, size_t n, size_t first) const {
+    // phase points as structure of arrays: component c (x, y, z, ux, uy, uz) of lane l at [c][l]
+    double y[6][ckLanes], yn[6][ckLanes], out[6][ckLanes], err[3][ckLanes];
+    double k[T::stages][6][ckLanes];
+    double h[ckLanes], hTry[ckLanes], qc[ckLanes];
+    double xyz[3 * ckLanes], B[3 * ckLanes];
+    size_t index[ckLanes], origin[ckLanes];
+    Candidate *lane[ckLanes];
+    VectorGridCursor cursors[ckLanes];
+
+    for (size_t l = 0; l < n; l++) {
+        Candidate *candidate = candidates[l];
+        ParticleState &current = candidate->current;
+        candidate->previous = current;
+
+        Vector3d x = current.getPosition();
+        Vector3d u = current.getDirection();
+        y[0][l] = x.x;
+        y[1][l] = x.y;
+        y[2][l] = x.z;
+        y[3][l] = u.x;
+        y[4][l] = u.y;
+        y[5][l] = u.z;
+        h[l] = clip(candidate->getNextStep(), minStep, maxStep) / c_light;
+        qc[l] = current.getCharge() * c_light / current.getEnergy();
+        lane[l] = candidate;
+        origin[l] = l;
+    }
+
+    // the first stage is shared by all tries, the field of candidates that
+    // start where their last step ended is taken from the cache
+    FieldCache *cache = fieldCaches.local();
+    size_t m = 0;
+    for (size_t l = 0; l < n; l++) {
+        Vector3d x(y[0][l], y[1][l], y[2][l]);
+        if (T::fsal && cache && cache->lookup(first + l, field, x, B + 3 * l))
+            continue;
+        index[m] = l;
+        for (size_t c = 0; c < 3; c++)
+            xyz[3 * m + c] = y[c][l];
+        m++;
+    }
+    if (m > 0) {
+        double fields[3 * ckLanes];
+        getFieldsAt(xyz, fields, m, cursors, index);
+        for (size_t i = 0; i < m; i++)
+            for (size_t c = 0; c < 3; c++)
+                B[3 * index[i] + c] = fields[3 * i + c];
+    }
+    for (size_t c = 0; c < 6; c++)
+        for (size_t l = 0; l < n; l++)
+            yn[c][l] = y[c][l];
+
+    // same step size control as in step, lanes that need another try are
+    // moved to the front, so n counts the pending lanes
+    for (size_t i = 0;; i++) {
+        // dY/dt of stage i, see dYdt
+        for (size_t l = 0; l < n; l++) {
+            double r = std::sqrt(yn[3][l] * yn[3][l] + yn[4][l] * yn[4][l] + yn[5][l] * yn[5][l]);
+            double vx = yn[3][l] / r * c_light;
+            double vy = yn[4][l] / r * c_light;
+            double vz = yn[5][l] / r * c_light;
+            const double *Bl = B + 3 * l;
+            k[i][0][l] = vx;
+            k[i][1][l] = vy;
+            k[i][2][l] = vz;
+            k[i][3][l] = qc[l] * (vy * Bl[2] - Bl[1] * vz);
+            k[i][4][l] = qc[l] * (vz * Bl[0] - Bl[2] * vx);
+            k[i][5][l] = qc[l] * (vx * Bl[1] - Bl[0] * vy);
+        }
+
+        if (i + 1 == T::stages) {
+            for (size_t c = 0; c < 6; c++)
+                for (size_t l = 0; l < n; l++)
+                    out[c][l] = y[c][l];
+            for (size_t c = 0; c < 3; c++)
+                for (size_t l = 0; l < n; l++)
+                    err[c][l] = 0;
+            for (size_t s = 0; s < T::stages; s++) {
+                for (size_t c = 0; c < 6; c++)
+                    for (size_t l = 0; l < n; l++)
+                        out[c][l] += k[s][c][l] * T::b[s] * hTry[l];
+                for (size_t c = 0; c < 3; c++)
+                    for (size_t l = 0; l < n; l++)
+                        err[c][l] += k[s][c + 3][l] * T::e[s] * hTry[l];
+            }
+
+            size_t nPending = 0;
+            for (size_t l = 0; l < n; l++) {
+                double r = std::sqrt(err[0][l] * err[0][l] + err[1][l] * err[1][l] + err[2][l] * err[2][l]) / tolerance;
+                double hNext = h[l] * (0.95 * pow(r, T::errorExponent));
+                hNext = clip(hNext, 0.1 * hTry[l], 5 * hTry[l]);
+
+                if (r > 1 && hNext > minStep) {
+                    // retry with the smaller step, keeping the first stage
+                    size_t p = nPending++;
+                    for (size_t c = 0; c < 6; c++) {
+                        y[c][p] = y[c][l];
+                        k[0][c][p] = k[0][c][l];
+                    }
+                    h[p] = hNext;
+                    qc[p] = qc[l];
+                    lane[p] = lane[l];
+                    origin[p] = origin[l];
+                    cursors[p] = cursors[l];
+                    continue;
+                }
+
+                if (T::fsal && cache) {
+                    double x[3] = { yn[0][l], yn[1][l], yn[2][l] };
+                    cache->store(first + origin[l], field, x, B + 3 * l);
+                }
+                Candidate *candidate = lane[l];
+                candidate->current.setPosition(Vector3d(out[0][l], out[1][l], out[2][l]));
+                candidate->current.setDirection(Vector3d(out[3][l], out[4][l], out[5][l]).getUnitVector());
+                candidate->setCurrentStep(hTry[l] * c_light);
+                candidate->setNextStep(hNext * c_light);
+            }
+            n = nPending;
+            if (n == 0)
+                break;
+            i = 0;
+        }
+
+        if (i == 0)
+            for (size_t l = 0; l < n; l++)
+                hTry[l] = h[l];
+
+        // input of stage i + 1
+        for (size_t c = 0; c < 6; c++)
+            for (size_t l = 0; l < n; l++)
+                yn[c][l] = y[c][l];
+        for (size_t j = 0; j <= i; j++)
+            for (size_t c = 0; c < 6; c++)
+                for (size_t l = 0; l < n; l++)
+                    yn[c][l] += k[j][c][l] * T::a[i + 1][j] * hTry[l];
+
+        // one field evaluation for all lanes
+        for (size_t l = 0; l < n; l++)
+            for (size_t c = 0; c < 3; c++)
+                xyz[3 * l + c] = yn[c][l];
+        getFieldsAt(xyz, B, n, cursors, 0);
+    }
+}
+
+void PropagationCK::setMethod(Method m) {
+    method = m;
+}
+
+PropagationCK::Method PropagationCK::getMethod() const {
+    return method;
+}
+
 void PropagationCK::setField(ref_ptr<MagneticField> f) {
     field = f;
+    gridField = dynamic_cast<const MagneticFieldGrid *>(f.get());
 }
 
 void PropagationCK::setTolerance(double tol) {
@@ -146,7 +516,13 @@ double PropagationCK::getMaximumStep() const {
 
 std::string PropagationCK::getDescription() const {
     std::stringstream s;
-    s << "Propagation in magnetic fields using the Cash-Karp method.";
+    s << "Propagation in magnetic fields using the ";
+    if (method == DormandPrince)
+        s << "Dormand-Prince method.";
+    else if (method == BogackiShampine)
+        s << "Bogacki-Shampine method.";
+    else
+        s << "Cash-Karp method.";
     s << " Target error: " << tolerance;
     s << ", Minimum Step: " << minStep / kpc << " kpc";
     s << ", Maximum Step: " << maxStep / kpc << " kpc";
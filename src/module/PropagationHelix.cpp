@@ -0,0 +1,186 @@
+#include "grpropa/module/PropagationHelix.h"
+#include "grpropa/magneticField/MagneticFieldGrid.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace grpropa {
+
+PropagationHelix::PropagationHelix(ref_ptr<MagneticField> field, double uniformity, double tolerance,
+        double minStep, double maxStep) :
+        minStep(0), maxStep(maxStep), useCells(false), cellSize(0) {
+    fallback = new PropagationCK(field, tolerance, minStep, maxStep);
+    setField(field);
+    setUniformity(uniformity);
+    setMaximumStep(maxStep);
+    setMinimumStep(minStep);
+}
+
+void PropagationHelix::moveOnHelix(Vector3d &position, Vector3d &direction, double step, double qc, const Vector3d &B) {
+    // du/dt = qc * c * (u x B) rotates u around -qc * B
+    double b = B.getR();
+    double theta = fabs(qc) * b * step; // rotation angle over the step
+    if (theta == 0) {
+        position += direction * step;
+        return;
+    }
+
+    Vector3d n = B * (qc > 0 ? -1. / b : 1. / b);
+    Vector3d uPar = n * direction.dot(n);
+    Vector3d uPerp = direction - uPar;
+    Vector3d w = n.cross(direction);
+
+    // sin(theta) / theta and (1 - cos(theta)) / theta, without cancellation for small angles
+    double s = sin(theta), h = sin(theta / 2);
+    double sinc = s / theta;
+    double cosc = 2 * h * h / theta;
+
+    position += (uPar + uPerp * sinc + w * cosc) * step;
+    direction = uPar + uPerp * cos(theta) + w * s;
+}
+
+double PropagationHelix::distanceToCellBoundary(const Vector3d &position, const Vector3d &direction) const {
+    Vector3d r = (position - cellOrigin) / cellSize;
+    double f[3] = { r.x - floor(r.x), r.y - floor(r.y), r.z - floor(r.z) };
+    double u[3] = { direction.x, direction.y, direction.z };
+    double d = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < 3; i++) {
+        if (u[i] > 0)
+            d = std::min(d, (1 - f[i]) / u[i]);
+        else if (u[i] < 0)
+            d = std::min(d, ((f[i] > 0) ? f[i] : 1.) / -u[i]);
+    }
+    return d * cellSize;
+}
+
+void PropagationHelix::process(Candidate *candidate) const {
+    ParticleState &current = candidate->current;
+    double step = clip(candidate->getNextStep(), minStep, maxStep);
+
+    // rectilinear propagation for neutral particles
+    if (current.getCharge() == 0) {
+        candidate->previous = current;
+        Vector3d pos = current.getPosition();
+        Vector3d dir = current.getDirection();
+        current.setPosition(pos + dir * step);
+        candidate->setCurrentStep(step);
+        candidate->setNextStep(maxStep);
+        return;
+    }
+
+    Vector3d x0 = current.getPosition();
+    Vector3d u0 = current.getDirection();
+
+    // end at the next cell boundary, or the one after when starting close to a boundary
+    if (useCells) {
+        double d = distanceToCellBoundary(x0, u0);
+        if (d < 0.01 * cellSize) {
+            double skip = 0.01 * cellSize;
+            d = skip + distanceToCellBoundary(x0 + u0 * skip, u0);
+        }
+        step = std::max(std::min(step, d), minStep);
+    }
+
+    double qc = current.getCharge() * c_light / current.getEnergy();
+    // a helix step usually stays in one interpolation cell of a field grid
+    VectorGridCursor cursor;
+    Vector3d B0 = fallback->getFieldAt(x0, cursor);
+    Vector3d x = x0, u = u0;
+    moveOnHelix(x, u, step, qc, B0);
+    Vector3d B1 = fallback->getFieldAt(x, cursor);
+
+    // direction error from the field change: relative change times deflection angle
+    double b = std::max(B0.getR(), B1.getR());
+    double error = (b > 0) ? (B1 - B0).getR() * fabs(qc) * step : 0;
+    if (error > uniformity) {
+        fallback->process(candidate);
+        return;
+    }
+
+    candidate->previous = current;
+    x = x0;
+    u = u0;
+    moveOnHelix(x, u, step, qc, (B0 + B1) / 2);
+    current.setPosition(x);
+    current.setDirection(u.getUnitVector());
+    candidate->setCurrentStep(step);
+
+    // the field change and the deflection both grow linearly with the step
+    double scale = (error > 0) ? 0.95 * sqrt(uniformity / error) : 5;
+    candidate->setNextStep(clip(step * clip(scale, 0.1, 5.), minStep, maxStep));
+}
+
+void PropagationHelix::setField(ref_ptr<MagneticField> f) {
+    field = f;
+    fallback->setField(f);
+
+    // interpolation cells of a field grid, between the grid points
+    ref_ptr<VectorGrid> grid;
+    if (MagneticFieldGrid *g = dynamic_cast<MagneticFieldGrid *>(f.get()))
+        grid = g->getGrid();
+    else if (ModulatedMagneticFieldGrid *g = dynamic_cast<ModulatedMagneticFieldGrid *>(f.get()))
+        grid = g->getGrid();
+    useCells = grid.valid();
+    if (useCells) {
+        cellSize = grid->getSpacing();
+        cellOrigin = grid->getOrigin() + Vector3d(cellSize / 2);
+    }
+}
+
+void PropagationHelix::setUniformity(double u) {
+    if ((u > 1) or (u <= 0))
+        throw std::runtime_error("PropagationHelix: uniformity not in range 0-1");
+    uniformity = u;
+}
+
+void PropagationHelix::setTolerance(double tolerance) {
+    fallback->setTolerance(tolerance);
+}
+
+void PropagationHelix::setMinimumStep(double min) {
+    if (min < 0)
+        throw std::runtime_error("PropagationHelix: minStep < 0 ");
+    if (min > maxStep)
+        throw std::runtime_error("PropagationHelix: minStep > maxStep");
+    minStep = min;
+    fallback->setMinimumStep(min);
+}
+
+void PropagationHelix::setMaximumStep(double max) {
+    if (max < minStep)
+        throw std::runtime_error("PropagationHelix: maxStep < minStep");
+    maxStep = max;
+    fallback->setMaximumStep(max);
+}
+
+double PropagationHelix::getUniformity() const {
+    return uniformity;
+}
+
+double PropagationHelix::getTolerance() const {
+    return fallback->getTolerance();
+}
+
+double PropagationHelix::getMinimumStep() const {
+    return minStep;
+}
+
+double PropagationHelix::getMaximumStep() const {
+    return maxStep;
+}
+
+std::string PropagationHelix::getDescription() const {
+    std::stringstream s;
+    s << "Propagation in magnetic fields on helices in locally uniform fields.";
+    s << " Uniformity: " << uniformity;
+    s << ", Fallback target error: " << getTolerance();
+    s << ", Minimum Step: " << minStep / kpc << " kpc";
+    s << ", Maximum Step: " << maxStep / kpc << " kpc";
+    if (useCells)
+        s << ", Grid cell: " << cellSize / kpc << " kpc";
+    return s.str();
+}
+
+} // namespace grpropa
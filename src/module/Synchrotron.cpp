@@ -18,12 +18,40 @@ void Synchrotron::process(Candidate *c) const {
     if (abs(c->current.getId()) != 11 )
         return;
 
+    Vector3d pos = c->current.getPosition();
+    loseEnergy(c, Bfield->getField(pos));
+}
+
+void Synchrotron::process(Candidate **candidates, size_t n) const {
+    // one field evaluation for all electrons and positrons of the batch
+    std::vector<Candidate *> leptons;
+    std::vector<double> xyz, b;
+    leptons.reserve(n);
+    xyz.reserve(3 * n);
+    for (size_t i = 0; i < n; i++) {
+        Candidate *c = candidates[i];
+        if (abs(c->current.getId()) != 11)
+            continue;
+        Vector3d pos = c->current.getPosition();
+        leptons.push_back(c);
+        xyz.push_back(pos.x);
+        xyz.push_back(pos.y);
+        xyz.push_back(pos.z);
+    }
+    if (leptons.empty())
+        return;
+
+    b.resize(xyz.size());
+    Bfield->getFields(&xyz[0], &b[0], leptons.size());
+    for (size_t i = 0; i < leptons.size(); i++)
+        loseEnergy(leptons[i], Vector3d(b[3 * i], b[3 * i + 1], b[3 * i + 2]));
+}
+
+void Synchrotron::loseEnergy(Candidate *c, const Vector3d &b) const {
     double z = c->getRedshift();
     double E = c->current.getEnergy();
     double gamma = c->current.getLorentzFactor();
-    Vector3d pos = c->current.getPosition();
-    Vector3d p = c->current.getMomentum();    
-    Vector3d b = Bfield->getField(pos);
+    Vector3d p = c->current.getMomentum();
     double B = b.getR();
 
     //E *= 1 + z;
@@ -50,6 +50,11 @@ void PerformanceModule::process(Candidate *candidate) const {
     }
 }
 
+void PerformanceModule::endRun() {
+    for (size_t i = 0; i < modules.size(); i++)
+        modules[i].module->endRun();
+}
+
 string PerformanceModule::getDescription() const {
     stringstream sstr;
     sstr << "PerformanceModule (";
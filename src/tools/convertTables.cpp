@@ -0,0 +1,63 @@
+// Converts the interaction data text files to binary table files,
+// which are mapped at startup instead of being parsed.
+// Usage: grpropa-convert-tables [data directory]
+
+#include "grpropa/PhotonBackground.h"
+#include "grpropa/Common.h"
+
+#include "kiss/path.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace grpropa;
+
+struct FieldFiles {
+    PhotonField photonField;
+    const char *name;
+};
+
+static const FieldFiles fieldFiles[] = {
+    {CMB, "CMB"},
+    {EBL_Gilmore12, "EBL_Gilmore12"},
+    {EBL_Dominguez11, "EBL_Dominguez11"},
+    {EBL_Dominguez11_UL, "EBL_Dominguez11_upper"},
+    {EBL_Dominguez11_LL, "EBL_Dominguez11_lower"},
+    {EBL_Finke10, "EBL_Finke10"},
+    {EBL_Kneiske10, "EBL_Kneiske10"},
+    {EBL_Franceschini08, "EBL_Franceschini08"},
+    {CRB_Protheroe96, "CRB_Protheroe96"},
+    {CRB_ARCADE2, "CRB_ARCADE2"}
+};
+
+static int convert(const std::string &directory, const std::string &name,
+        PhotonField photonField, TableKind kind) {
+    std::string textFile = concat_path(directory, name + ".txt");
+    if (!std::ifstream(textFile.c_str()).good())
+        return 0;
+    std::string tableFile = binaryTableFilename(textFile);
+    try {
+        convertInteractionTable(textFile, tableFile, photonField, kind);
+    } catch (std::exception &e) {
+        std::cerr << "  failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "  " << textFile << " -> " << tableFile << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::string directory = (argc > 1) ? argv[1] : getDataPath("");
+    std::cout << "grpropa-convert-tables: " << directory << std::endl;
+
+    int errors = 0;
+    for (size_t i = 0; i < sizeof(fieldFiles) / sizeof(FieldFiles); i++) {
+        const FieldFiles &f = fieldFiles[i];
+        std::string name = f.name;
+        errors += convert(directory, "PP-" + name, f.photonField, InteractionRateTableKind);
+        errors += convert(directory, "ICS-" + name, f.photonField, InteractionRateTableKind);
+        errors += convert(directory, "photonProbabilities-" + name, f.photonField, PhotonEnergyTableKind);
+    }
+    return errors ? 1 : 0;
+}
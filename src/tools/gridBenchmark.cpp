@@ -0,0 +1,185 @@
+// Measures the trilinear interpolation of a VectorGrid in the linear and the
+// bricked memory layout, in time per query and, where the kernel provides the
+// hardware counters, in last-level cache and data TLB misses per query.
+// The grid values are mapped anonymously, optionally without transparent huge
+// pages, which otherwise hide most TLB misses. The grid should be much larger
+// than the last-level cache (a 512^3 grid takes 1.5 GB, a 1024^3 grid 12 GB).
+// Usage: grpropa-grid-benchmark [grid points per axis] [queries] [nohugepages]
+
+#include "grpropa/Grid.h"
+#include "grpropa/Random.h"
+
+#include <sys/mman.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace grpropa;
+
+static double wallTime() {
+    timeval t;
+    gettimeofday(&t, 0);
+    return t.tv_sec + 1e-6 * t.tv_usec;
+}
+
+// anonymous mapping that owns the values of a grid
+class Mapping: public Referenced {
+public:
+    void *data;
+    size_t size;
+    Mapping(size_t size, bool hugePages) :
+            size(size) {
+        data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("grpropa-grid-benchmark: could not map the grid");
+#ifdef MADV_NOHUGEPAGE
+        if (!hugePages)
+            madvise(data, size, MADV_NOHUGEPAGE);
+#endif
+    }
+    ~Mapping() {
+        munmap(data, size);
+    }
+};
+
+// hardware counter of the calling thread in user space, -1 if not available
+class Counter {
+    int fd;
+public:
+    Counter(unsigned int type, unsigned long long config) :
+            fd(-1) {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~Counter() {
+        if (fd >= 0)
+            close(fd);
+    }
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    double stop() {
+        long long count = -1;
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = -1;
+        }
+#endif
+        return count;
+    }
+};
+
+enum Pattern {
+    Walk, /**< one particle moving 0.3 cells per query */
+    Walkers, /**< 1024 particles moving 0.3 cells per query in turn */
+    Jumps /**< uniformly random positions */
+};
+
+static const char *patternNames[] = {"walk", "walkers", "jumps"};
+
+static void measure(const VectorGrid &grid, Pattern pattern, size_t queries) {
+    Random random(42);
+    double size = grid.getNx();
+    size_t nWalkers = (pattern == Walkers) ? 1024 : 1;
+    std::vector<Vector3d> position(nWalkers), direction(nWalkers);
+    for (size_t i = 0; i < nWalkers; i++) {
+        position[i] = Vector3d(random.rand(size), random.rand(size), random.rand(size));
+        direction[i] = random.randVector();
+    }
+    // precompute the jumps, so that the loop measures the grid only
+    std::vector<Vector3d> jumps;
+    if (pattern == Jumps) {
+        jumps.resize(queries);
+        for (size_t i = 0; i < queries; i++)
+            jumps[i] = Vector3d(random.rand(size), random.rand(size), random.rand(size));
+    }
+
+#ifdef __linux__
+    Counter cacheMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    Counter tlbMisses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+            | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+    Counter cacheMisses(0, 0), tlbMisses(0, 0);
+#endif
+    Vector3f sum(0.f);
+    double t = wallTime();
+    cacheMisses.start();
+    tlbMisses.start();
+    for (size_t i = 0; i < queries; i++) {
+        if (pattern == Jumps) {
+            sum += grid.interpolate(jumps[i]);
+            continue;
+        }
+        size_t j = i % nWalkers;
+        position[j] += direction[j] * 0.3;
+        sum += grid.interpolate(position[j]);
+    }
+    double llc = cacheMisses.stop();
+    double tlb = tlbMisses.stop();
+    t = wallTime() - t;
+
+    printf("  %-8s %7.1f ns", patternNames[pattern], t / queries * 1e9);
+    if (llc >= 0)
+        printf("  %6.3f LLC misses", llc / queries);
+    else
+        printf("  LLC misses n/a");
+    if (tlb >= 0)
+        printf("  %6.3f dTLB misses", tlb / queries);
+    else
+        printf("  dTLB misses n/a");
+    printf("  (checksum %g)\n", sum.x + sum.y + sum.z);
+}
+
+int main(int argc, char **argv) {
+    size_t N = (argc > 1) ? atol(argv[1]) : 512;
+    size_t queries = (argc > 2) ? atol(argv[2]) : 10000000;
+    bool hugePages = !((argc > 3) && (std::string(argv[3]) == "nohugepages"));
+
+    GridLayout layouts[] = {LinearGridLayout, BrickedGridLayout};
+    const char *layoutNames[] = {"linear", "bricked"};
+    for (size_t l = 0; l < 2; l++) {
+        size_t B = (N + 7) / 8;
+        size_t n = (layouts[l] == LinearGridLayout) ? N * N * N : B * B * B * 512;
+        ref_ptr<Mapping> mapping = new Mapping(n * sizeof(Vector3f), hugePages);
+
+        VectorGrid grid(Vector3d(0.), 0, 1., layouts[l]);
+        grid.setExternalValues(N, N, N, static_cast<Vector3f *>(mapping->data), mapping);
+        for (size_t ix = 0; ix < N; ix++)
+            for (size_t iy = 0; iy < N; iy++)
+                for (size_t iz = 0; iz < N; iz++)
+                    grid.get(ix, iy, iz) = Vector3f(ix % 7, iy % 5, iz % 3);
+
+        printf("%s layout, %lu^3 grid, %.2f GB%s\n", layoutNames[l], (unsigned long) N,
+                n * sizeof(Vector3f) / 1e9, hugePages ? "" : ", no huge pages");
+        for (int p = Walk; p <= Jumps; p++)
+            measure(grid, Pattern(p), queries);
+    }
+    return 0;
+}